@@ -6,15 +6,38 @@ layout(location = 2) in vec2 vertTex;
 uniform mat4 P;
 uniform mat4 V;
 uniform mat4 M;
+// vertex animation texture: with vatFrames > 0 the mesh sits on joint vatJoint at vatTime,
+// placed by M * joint matrix * Mbone, otherwise M alone places it
+uniform sampler2D Mvat;
+uniform int vatFirst;		// texture row of the first frame of the clip
+uniform int vatFrames;		// rows of the clip
+uniform float vatTime;		// instance time, 0..1 of the clip
+uniform int vatJoint;
+uniform mat4 Mbone;
 
 out vec3 fragPos;
 //out vec3 fragNor;
 //out vec2 fragTex;
 //out vec3 lightPos;
 
+// the two frames around vatTime mixed, like anim_vat::sample
+mat4 vat(int joint)
+{
+    float f = fract(vatTime) * float(vatFrames - 1);
+    int k = clamp(int(f), 0, max(vatFrames - 2, 0));
+    float a = f - float(k);
+    int row0 = vatFirst + k;
+    int row1 = vatFirst + min(k + 1, vatFrames - 1);
+    vec4 r0 = mix(texelFetch(Mvat, ivec2(joint * 3, row0), 0), texelFetch(Mvat, ivec2(joint * 3, row1), 0), a);
+    vec4 r1 = mix(texelFetch(Mvat, ivec2(joint * 3 + 1, row0), 0), texelFetch(Mvat, ivec2(joint * 3 + 1, row1), 0), a);
+    vec4 r2 = mix(texelFetch(Mvat, ivec2(joint * 3 + 2, row0), 0), texelFetch(Mvat, ivec2(joint * 3 + 2, row1), 0), a);
+    return transpose(mat4(r0, r1, r2, vec4(0, 0, 0, 1)));
+}
+
 void main() {
-    gl_Position = P * V * M * vec4(vertPos, 1.0);
-    fragPos = vec4(V * M * vec4(vertPos, 1.0)).xyz;
+    mat4 Mw = vatFrames > 0 ? M * vat(vatJoint) * Mbone : M;
+    gl_Position = P * V * Mw * vec4(vertPos, 1.0);
+    fragPos = vec4(V * Mw * vec4(vertPos, 1.0)).xyz;
 //    fragNor = vec4(V * M * vec4(vertNor, 0.0)).xyz;
 //    fragTex = vertTex;
 //    lightPos = vec3(V * vec4(100, 100, 100, 1));
@@ -9,7 +9,13 @@ layout(location = 3) in int vertimat;
 uniform mat4 P;
 uniform mat4 V;
 uniform mat4 M;
-uniform mat4 Manim[200];
+// animation palette, 3 texels per joint: the rows of the 3x4 world matrix
+uniform samplerBuffer Manim;
+// vertex animation texture, read instead of Manim while vatFrames > 0
+uniform sampler2D Mvat;
+uniform int vatFirst;		// texture row of the first frame of the clip
+uniform int vatFrames;		// rows of the clip, 0 reads Manim
+uniform float vatTime;		// instance time, 0..1 of the clip
 
 out vec3 vertex_pos;
 // old anim void main()
@@ -21,10 +27,32 @@ out vec3 vertex_pos;
 
 // }
 
+mat4 palette(int joint)
+{
+    vec4 r0 = texelFetch(Manim, joint * 3);
+    vec4 r1 = texelFetch(Manim, joint * 3 + 1);
+    vec4 r2 = texelFetch(Manim, joint * 3 + 2);
+    return transpose(mat4(r0, r1, r2, vec4(0, 0, 0, 1)));
+}
+
+// the two frames around vatTime mixed, like anim_vat::sample
+mat4 vat(int joint)
+{
+    float f = fract(vatTime) * float(vatFrames - 1);
+    int k = clamp(int(f), 0, max(vatFrames - 2, 0));
+    float a = f - float(k);
+    int row0 = vatFirst + k;
+    int row1 = vatFirst + min(k + 1, vatFrames - 1);
+    vec4 r0 = mix(texelFetch(Mvat, ivec2(joint * 3, row0), 0), texelFetch(Mvat, ivec2(joint * 3, row1), 0), a);
+    vec4 r1 = mix(texelFetch(Mvat, ivec2(joint * 3 + 1, row0), 0), texelFetch(Mvat, ivec2(joint * 3 + 1, row1), 0), a);
+    vec4 r2 = mix(texelFetch(Mvat, ivec2(joint * 3 + 2, row0), 0), texelFetch(Mvat, ivec2(joint * 3 + 2, row1), 0), a);
+    return transpose(mat4(r0, r1, r2, vec4(0, 0, 0, 1)));
+}
+
 void main()
 {
 
-    mat4 Ma = Manim[vertimat];
+    mat4 Ma = vatFrames > 0 ? vat(vertimat) : palette(vertimat);
     vec4 pos;// = Ma*vec4(vertPos,1.0);
 
 //the animation matrix already holds the end position for the segment
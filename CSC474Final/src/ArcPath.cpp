@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "ArcPath.h"
+#include "line.h"
+
+using namespace std;
+using namespace glm;
+
+// v without its part along the unit vector t, normalized; any normal of t if v is along t
+static vec3 perpendicular(const vec3 &v, const vec3 &t) {
+	vec3 p = v - dot(v, t) * t;
+	if (length(p) > 1e-6f) return normalize(p);
+	return normalize(cross(t, fabs(t.x) < 0.9f ? vec3(1, 0, 0) : vec3(0, 1, 0)));
+}
+
+void ArcPath::build(const vector<mat3> &controlpts, float curly, int samplesPerSegment, bool twistToUps) {
+
+	segments = 0;
+	length = 0;
+	twist = twistToUps;
+	if (controlpts.size() < 3 || samplesPerSegment < 1) {
+		ctrl.clear();
+		dist.clear();
+		frames.clear();
+		return;
+	}
+
+	vector<vec3> points, tangents;
+	for (int i = 0; i < controlpts.size(); i++)
+		points.push_back(controlpts[i][0]);
+	cardinal_tangents(tangents, points, curly);
+
+	samples = samplesPerSegment;
+	rebuild(points, tangents, controlpts, 0);
+}
+
+void ArcPath::update(const CardinalSpline &spline, const vector<mat3> &controlpts) {
+
+	if (spline.size() != controlpts.size() || spline.size() < 3) {
+		build(controlpts, 1.0f, samples > 0 ? samples : 32, twist);
+		return;
+	}
+	if (samples < 1) samples = 32;
+	// a path that was not valid before has nothing to keep
+	int first = isValid() ? spline.first_changed : 0;
+	rebuild(spline.points(), spline.tangents(), controlpts, first);
+}
+
+void ArcPath::rebuild(const vector<vec3> &points, const vector<vec3> &tangents, const vector<mat3> &controlpts, int firstSegment) {
+
+	// the segments before firstSegment and their distances stay
+	firstSegment = std::min(std::max(firstSegment, 0), std::min(segments, (int)points.size() - 1));
+	segments = points.size() - 1;
+	ctrl.resize(firstSegment * 4);
+	dist.resize(firstSegment * samples);
+
+	for (int i = firstSegment; i < segments; i++) {
+		ctrl.push_back(points[i]);
+		ctrl.push_back(points[i] + tangents[i]);
+		ctrl.push_back(points[i + 1] - tangents[i + 1]);
+		ctrl.push_back(points[i + 1]);
+	}
+
+	// chord lengths of the samples add up to the distance table
+	length = firstSegment > 0 ? dist.back() : 0;
+	vec3 last = firstSegment > 0 ? bezier(firstSegment - 1, (samples - 1.0f) / samples) : ctrl[0];
+	for (int seg = firstSegment; seg < segments; seg++)
+		for (int i = 0; i < samples; i++) {
+			vec3 p = bezier(seg, (float)i / samples);
+			length += distance(last, p);
+			dist.push_back(length);
+			last = p;
+		}
+	length += distance(last, ctrl.back());
+	dist.push_back(length);
+
+	// rotation minimizing frames by double reflection (Wang et al. 2008): the up vector is
+	// mirrored on the chord to the next sample, then on the difference of the tangents
+	vec3 x0, t0, r0;
+	if (firstSegment == 0 || frames.size() < firstSegment * samples + 1) {
+		firstSegment = 0;
+		frames.clear();
+		x0 = ctrl[0];
+		t0 = direction(0, 0);
+		r0 = perpendicular(controlpts[0][1], t0);
+		pushFrame(r0, t0);
+	}
+	else {
+		frames.resize(firstSegment * samples + 1);
+		x0 = ctrl[firstSegment * 4];
+		t0 = direction(firstSegment, 0);
+		r0 = frames.back() * vec3(0, 1, 0);
+	}
+	for (int seg = firstSegment; seg < segments; seg++) {
+		int begin = frames.size();
+		for (int i = 1; i <= samples; i++) {
+			float u = (float)i / samples;
+			vec3 x1 = bezier(seg, u);
+			vec3 t1 = direction(seg, u);
+			vec3 v1 = x1 - x0;
+			float c1 = dot(v1, v1);
+			vec3 rL = r0, tL = t0;
+			if (c1 > 0) {
+				rL -= (2 / c1) * dot(v1, r0) * v1;
+				tL -= (2 / c1) * dot(v1, t0) * v1;
+			}
+			vec3 v2 = t1 - tL;
+			float c2 = dot(v2, v2);
+			vec3 r1 = c2 > 0 ? rL - (2 / c2) * dot(v2, rL) * v2 : rL;
+			pushFrame(r1, t1);
+			x0 = x1;
+			t0 = t1;
+			r0 = r1;
+		}
+		if (!twist) continue;
+
+		// roll about the tangent so the segment ends on the up of its control point
+		vec3 up = perpendicular(controlpts[seg + 1][1], t0);
+		float angle = atan2(dot(cross(r0, up), t0), dot(r0, up));
+		float d0 = dist[seg * samples], span = dist[(seg + 1) * samples] - d0;
+		for (int k = begin; k < frames.size(); k++) {
+			float w = span > 0 ? (dist[k] - d0) / span : 1.0f;
+			frames[k] = normalize(frames[k] * angleAxis(angle * w, vec3(0, 0, 1)));
+		}
+		r0 = up;
+	}
+}
+
+void ArcPath::pushFrame(const vec3 &up, const vec3 &forward) {
+	vec3 ey = normalize(up - dot(up, forward) * forward);
+	quat q = normalize(quat_cast(mat3(cross(ey, forward), ey, forward)));
+	// neighbours on the same side of the sphere, so blending them takes the short way
+	if (!frames.empty() && dot(q, frames.back()) < 0)
+		q = -q;
+	frames.push_back(q);
+}
+
+float ArcPath::wrap(float s) const {
+	if (length <= 0) return 0;
+	s = fmod(s, length);
+	return s < 0 ? s + length : s;
+}
+
+void ArcPath::locateSample(float s, int &k, float &a) const {
+	s = wrap(s);
+	int n = dist.size() - 1;
+	k = upper_bound(dist.begin(), dist.end(), s) - dist.begin() - 1;
+	k = std::min(std::max(k, 0), n - 1);
+	float span = dist[k + 1] - dist[k];
+	a = span > 0 ? std::min(std::max((s - dist[k]) / span, 0.0f), 1.0f) : 0.0f;
+}
+
+void ArcPath::locate(float s, int &seg, float &u) const {
+	int k;
+	float a;
+	locateSample(s, k, a);
+	seg = k / samples;
+	u = (k % samples + a) / samples;
+}
+
+vec3 ArcPath::bezier(int seg, float u) const {
+	const vec3 *c = &ctrl[seg * 4];
+	float t1 = 1 - u;
+	return c[0] * (t1 * t1 * t1) + c[1] * (3 * u * t1 * t1) + c[2] * (3 * u * u * t1) + c[3] * (u * u * u);
+}
+
+vec3 ArcPath::bezierDerivative(int seg, float u) const {
+	const vec3 *c = &ctrl[seg * 4];
+	float t1 = 1 - u;
+	return (c[1] - c[0]) * (3 * t1 * t1) + (c[2] - c[1]) * (6 * u * t1) + (c[3] - c[2]) * (3 * u * u);
+}
+
+vec3 ArcPath::positionAt(float s) const {
+	if (!isValid()) return vec3(0);
+	int seg;
+	float u;
+	locate(s, seg, u);
+	return bezier(seg, u);
+}
+
+vec3 ArcPath::tangentAt(float s) const {
+	if (!isValid()) return vec3(0, 0, 1);
+	int seg;
+	float u;
+	locate(s, seg, u);
+	return direction(seg, u);
+}
+
+vec3 ArcPath::direction(int seg, float u) const {
+	vec3 d = bezierDerivative(seg, u);
+	float len = glm::length(d);
+	if (len > 0) return d / len;
+	// the tangents are zero at the ends of the path, the curve leaves toward the next bezier point
+	const vec3 *c = &ctrl[seg * 4];
+	d = u < 0.5f ? c[2] - c[0] : c[3] - c[1];
+	return glm::length(d) > 0 ? normalize(d) : vec3(0, 0, 1);
+}
+
+mat4 ArcPath::frameAt(float s) const {
+	if (!isValid()) return mat4(0.0);
+	int k;
+	float a;
+	locateSample(s, k, a);
+	quat q = normalize(frames[k] * (1 - a) + frames[k + 1] * a);
+	return translate(mat4(1.0f), bezier(k / samples, (k % samples + a) / samples)) * mat4_cast(q);
+}
@@ -0,0 +1,61 @@
+#pragma  once
+#ifndef ArcPath_h
+#define ArcPath_h
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class CardinalSpline;
+
+
+/***************************************/
+
+// Cardinal spline through the control points (the curve cardinal_curve draws), parameterized
+// by arc length. build() samples every segment once into a table of distances, a query
+// finds the two samples around a distance by binary search and inverts the segment
+// parameter between them, so followers move at constant speed whatever the segment lengths.
+// Distances loop over the length of the path.
+// Every sample also gets a rotation minimizing frame: the up vector is carried along the
+// curve without turning about the tangent, starting from the up of the first control point.
+// With twist the frames of a segment roll toward the up of its end point, spread by
+// distance. frameAt() only blends the two cached frames around a distance.
+class ArcPath {
+public:
+	ArcPath() {}
+	~ArcPath() {}
+
+	// controlpts like ControlPoint::points: position, up and look at direction
+	void build(const std::vector<glm::mat3> &controlpts, float curly = 1.0f, int samplesPerSegment = 32, bool twist = true);
+	// after an edit of spline, whose points are those of controlpts: only the segments from
+	// spline.first_changed on are sampled again
+	void update(const CardinalSpline &spline, const std::vector<glm::mat3> &controlpts);
+	bool isValid() const { return segments > 0; }		// false below 3 control points
+	float getLength() const { return length; }
+	int getSegments() const { return segments; }
+	float wrap(float s) const;
+
+	glm::vec3 positionAt(float s) const;
+	glm::vec3 tangentAt(float s) const;		// unit length
+	// translation and rotation at s: z along the tangent, y up
+	glm::mat4 frameAt(float s) const;
+
+private:
+	void rebuild(const std::vector<glm::vec3> &points, const std::vector<glm::vec3> &tangents, const std::vector<glm::mat3> &controlpts, int firstSegment);
+	void locateSample(float s, int &k, float &a) const;	// table entry k before distance s and the fraction to k + 1
+	void locate(float s, int &seg, float &u) const;		// segment and curve parameter at distance s
+	glm::vec3 bezier(int seg, float u) const;
+	glm::vec3 bezierDerivative(int seg, float u) const;
+	glm::vec3 direction(int seg, float u) const;			// unit tangent, also where the derivative is zero
+	void pushFrame(const glm::vec3 &up, const glm::vec3 &forward);
+
+	int segments = 0;
+	int samples = 0;						// table entries per segment
+	float length = 0;
+	bool twist = true;
+	std::vector<glm::vec3> ctrl;			// 4 bezier points per segment
+	std::vector<float> dist;				// distance at u = i / samples of segment seg, [seg * samples + i], then the length
+	std::vector<glm::quat> frames;			// frame at every entry of dist
+};
+
+#endif /* ArcPath_h */
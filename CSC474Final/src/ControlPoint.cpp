@@ -3,6 +3,8 @@
 #include <fstream>
 #include <glm/glm.hpp>
 #include <string>
+#include <cstring>
+#include <cstdlib>
 #define GLM_ENABLE_EXPERIMENTAL
 #include "glm/gtx/string_cast.hpp"
 #include <glm/gtc/matrix_transform.hpp>
@@ -10,122 +12,261 @@
 
 #include "ControlPoint.h"
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 using namespace std;
 using namespace glm;
 
+// FNV-1a of the floats of a record
+static uint32_t recordChecksum(const JournalRecord &rec) {
+	const unsigned char *c = (const unsigned char *)rec.point;
+	uint32_t h = 2166136261u;
+	for (int i = 0; i < sizeof(rec.point); i++)
+		h = (h ^ c[i]) * 16777619u;
+	return h;
+}
+
+// reads the records after the header up to the first damaged one and returns how many
+// were good; points gets them if not NULL
+static size_t readRecords(ifstream &in, vector<mat3> *points, bool &damaged) {
+	vector<JournalRecord> chunk(4096);
+	size_t count = 0;
+	damaged = false;
+	while (!damaged) {
+		in.read((char *)chunk.data(), chunk.size() * sizeof(JournalRecord));
+		size_t got = in.gcount() / sizeof(JournalRecord);
+		for (size_t i = 0; i < got && !damaged; i++) {
+			if (chunk[i].checksum != recordChecksum(chunk[i])) {
+				damaged = true;
+				break;
+			}
+			const float *v = chunk[i].point;
+			if (points)
+				points->push_back(mat3(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]));
+			count++;
+		}
+		if (in.gcount() % sizeof(JournalRecord) != 0)		// cut off in the middle of a record
+			damaged = true;
+		if (got < chunk.size())
+			break;
+	}
+	return count;
+}
+
+// shortens the file to size bytes
+static bool truncateFile(const string &filename, streamoff size) {
+#ifdef _WIN32
+	FILE *f = fopen(filename.c_str(), "r+b");
+	if (!f) return false;
+	bool ok = _chsize_s(_fileno(f), size) == 0;
+	fclose(f);
+	return ok;
+#else
+	return ::truncate(filename.c_str(), size) == 0;
+#endif
+}
+
 bool ControlPoint::loadPoints(string filename) {
 
 	cout << "[ControlPoints.cpp] Loading points from file: " << filename << endl;
 
-	file.open(filename, ios::in);	// ---------- open file
-	if (!file.is_open()) {
+	ifstream in(filename, ios::in | ios::binary);	// ---------- open file
+	if (!in.is_open()) {
 		cout << "Warning: Could not open file - " << filename << endl;
 		return false;
 	}
 
-	try {
-
-		string line;
-		while (file.peek() != EOF) {
-			getline(file, line);							// get line from file
-
-			const char * const_c_line = line.c_str();		// setup line to be parsed
-			char * c_line = new char[line.length() + 1];
-			strcpy(c_line, line.c_str());
+	char magic[8] = { 0 };
+	in.read(magic, sizeof(magic));
+	in.clear();
+	in.seekg(0);
+	bool loaded = memcmp(magic, CP_JOURNAL_MAGIC, sizeof(magic)) == 0 ? loadJournal(in, filename) : loadText(in, filename);
 
-			mat3 pt = mat3(1.0);							// store point here
-
-			if (c_line[0] != '\n' && c_line[0] != '\0') {
-					char * c = "\0";
+	// build model matrix for each new point
+	buildModelMat();
 
-					c = strtok(c_line, " \n");		// x	// X BASE - pos
-					pt[0].x = stof(string(c));
-					c = strtok(NULL, " \n");		// y
-					pt[0].y = stof(string(c));
-					c = strtok(NULL, " \n");		// z
-					pt[0].z = stof(string(c));
+	return loaded;
+}
 
-					c = strtok(NULL, " \n");		// x	// Y BASE - up
-					pt[1].x = stof(string(c));
-					c = strtok(NULL, " \n");		// y
-					pt[1].y = stof(string(c));
-					c = strtok(NULL, " \n");		// z
-					pt[1].z = stof(string(c));
+bool ControlPoint::loadJournal(ifstream &in, string filename) {
 
-					c = strtok(NULL, " \n");		// x	// Z BASE - dir
-					pt[2].x = stof(string(c));
-					c = strtok(NULL, " \n");		// y
-					pt[2].y = stof(string(c));
-					c = strtok(NULL, " \n");		// z
-					pt[2].z = stof(string(c));
+	JournalHeader header;
+	if (!in.read((char *)&header, sizeof(header)) || header.version != CP_JOURNAL_VERSION || header.recordSize != sizeof(JournalRecord)) {
+		cout << "Warning: " << filename << " is not a path journal of this version" << endl;
+		return false;
+	}
 
-					points.push_back(pt);			// add point to vector
-				}
+	bool damaged;
+	size_t count = readRecords(in, &points, damaged);
+	if (damaged)
+		cout << "Warning: " << filename << " ends in a damaged record, loaded the " << count << " points before it" << endl;
+	return true;
+}
 
-			delete[] c_line;								// delete temp string buffer
+bool ControlPoint::loadText(ifstream &in, string filename) {
+
+	string line;
+	int skipped = 0;
+	while (getline(in, line)) {							// get line from file
+		float v[9];
+		int k = 0;
+		const char *c = line.c_str();
+		char *end;
+		for (; k < 9; k++, c = end) {
+			v[k] = strtof(c, &end);
+			if (end == c) break;
 		}
-
+		if (k == 0 && line.find_first_not_of(" \t\r") == string::npos)
+			continue;									// empty line
+		if (k < 9) {
+			skipped++;
+			continue;
+		}
+		points.push_back(mat3(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]));
 	}
-	catch (exception e) {
-		cout << "ERROR: File format must be: " << endl;
-		cout << "/n " << endl;
+
+	if (skipped > 0) {
+		cout << "ERROR: skipped " << skipped << " lines of " << filename << ", the format must be: " << endl;
 		cout << "x1 y1 z1 x2 y2 z2 x3 y3 z3" << endl;
 		cout << endl;
 	}
-
-
-	// build model matrix for each point
-	buildModelMat();
-
-	file.close();			// ------- close file
-
 	return true;
+}
 
+bool ControlPoint::exportPoints(string filename) {
+
+	ofstream out(filename, ios::out | ios::trunc);
+	if (!out.is_open()) {
+		cout << "Warning: Could not open file - " << filename << endl;
+		return false;
+	}
+	out.precision(9);									// floats read back exactly
+	for (int i = 0; i < points.size(); i++) {
+		const mat3 &pt = points[i];
+		out << pt[0].x << " " << pt[0].y << " " << pt[0].z << " ";		// pos
+		out << pt[1].x << " " << pt[1].y << " " << pt[1].z << " ";		// up
+		out << pt[2].x << " " << pt[2].y << " " << pt[2].z << "\n";	// dir
+	}
+	return out.good();
 }
 
 bool ControlPoint::clearPoints(string filename) {
 	cout << "[ControlPoints.cpp] Clearing points from file: " << filename << endl;
 
-	file.open(filename, ios::out);	// ---------- open file
-	if (!file.is_open()) {
+	if (filename == journalName)
+		closeJournal();
+	if (filename == refusedJournal)
+		refusedJournal.clear();			// an empty file starts a new journal
+	ofstream out(filename, ios::out | ios::trunc);	// ---------- open file
+	if (!out.is_open()) {
 		cout << "Warning: Could not open file - " << filename << endl;
 		return false;
 	}
-
-	file.close();
 	return true;
 }
 
-// is it to open the file every time they wanna add points?
-glm::mat3 ControlPoint::addPoint(vec3 pos, vec3 up, vec3 dir, string filename) {
+bool ControlPoint::openJournal(string filename) {
+
+	closeJournal();
+	refusedJournal = filename;
+
+	// new records go after the good part of an existing journal
+	streamoff end = 0, fileSize = 0;
+	{
+		ifstream in(filename, ios::in | ios::binary);
+		JournalHeader header;
+		if (in.is_open() && in.read((char *)&header, sizeof(header))) {
+			if (memcmp(header.magic, CP_JOURNAL_MAGIC, sizeof(header.magic)) != 0 || header.version != CP_JOURNAL_VERSION || header.recordSize != sizeof(JournalRecord)) {
+				cout << "Warning: " << filename << " is not a path journal of this version, not writing to it" << endl;
+				return false;
+			}
+			bool damaged;
+			end = sizeof(header) + readRecords(in, NULL, damaged) * sizeof(JournalRecord);
+			in.clear();
+			in.seekg(0, ios::end);
+			fileSize = in.tellg();
+		}
+	}
 
-	file.open(filename, ios::out | ios::app);	// ---------- open file | write | append
-	if (!file.is_open()) {
+	// cut off a damaged tail, or the records after it would load again once new ones close the gap
+	if (end > 0 && fileSize > end && !truncateFile(filename, end)) {
+		cout << "Warning: Could not cut the damaged end off " << filename << ", not writing to it" << endl;
+		return false;
+	}
+
+	if (end > 0) {
+		file.open(filename, ios::in | ios::out | ios::binary);
+		file.seekp(end);
+	}
+	else {
+		// a new journal, with the points there are so far
+		file.open(filename, ios::out | ios::binary | ios::trunc);
+		JournalHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, CP_JOURNAL_MAGIC, sizeof(header.magic));
+		header.version = CP_JOURNAL_VERSION;
+		header.recordSize = sizeof(JournalRecord);
+		file.write((const char *)&header, sizeof(header));
+		journalName = filename;
+		for (int i = 0; i < points.size(); i++)
+			writeRecord(points[i]);
+		file.flush();
+	}
+	if (!file.is_open() || !file.good()) {
 		cout << "Warning: Could not open file - " << filename << endl;
+		closeJournal();
+		return false;
 	}
+	journalName = filename;
+	refusedJournal.clear();
+	return true;
+}
+
+void ControlPoint::closeJournal() {
+	if (file.is_open())
+		file.close();
+	journalName.clear();
+}
+
+bool ControlPoint::writeRecord(const mat3 &pt) {
+	JournalRecord rec;
+	for (int i = 0; i < 9; i++)
+		rec.point[i] = pt[i / 3][i % 3];
+	rec.checksum = recordChecksum(rec);
+	file.write((const char *)&rec, sizeof(rec));
+	return file.good();
+}
+
+// the journal stays open, adding a point only appends one record
+glm::mat3 ControlPoint::addPoint(vec3 pos, vec3 up, vec3 dir, string filename) {
+
+	// a file that could not be opened is not tried again for every point
+	if (filename != journalName && filename != refusedJournal)
+		openJournal(filename);
 
 	pos *= -1.0f; //up *= -1.0f; dir *= -1.0f;				// control point is inverse of camera pos
 	mat3 pt = mat3(pos, up, dir);
 	points.push_back(pt);
 
 	// write mat to file
-	file << endl;
-	file << pos.x << " " << pos.y << " " << pos.z << " ";		// pos
-	file << up.x << " " << up.y << " " << up.z << " ";			// up
-	file << dir.x << " " << dir.y << " " << dir.z << endl;		// dir
+	// flushed right away, a crash only loses the record being written
+	if (!journalName.empty() && (!writeRecord(pt) || !file.flush()))
+		cout << "Warning: Could not write to file - " << filename << endl;
 
-	// build model matrix for each point
+	// build model matrix for the new point
 	buildModelMat();
 
-	file.close();
-
 	return pt;
 }
 
-// Fill array of model matrices
+// Fill array of model matrices, from the first point without one
 void ControlPoint::buildModelMat() {
 
-	for (int i = 0; i < points.size(); i++) {
+	for (int i = modelMats.size(); i < points.size(); i++) {
 
 		// get rotation
 		mat4 rotM = mat4(1.0);
@@ -7,11 +7,30 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <stdint.h>
 //#include <string>
 
 
 /***************************************/
 
+// Binary path journal: a header, then one record per control point in the order they
+// were added. Points are only ever appended and flushed one by one, each record carries
+// a checksum of its floats, so a record cut off by a crash or damaged ends the journal
+// there and the points before it still load. Appending cuts the file off at that point.
+#define CP_JOURNAL_MAGIC "CPJOURNL"
+#define CP_JOURNAL_VERSION 1
+
+struct JournalHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+};
+
+struct JournalRecord {
+	float point[9];			// position, up, look at direction, like a row of the text format
+	uint32_t checksum;
+};
+
 class ControlPoint {
 public:
 
@@ -20,16 +39,30 @@ public:
 	std::fstream file;
 
 	ControlPoint() {}
-	~ControlPoint() {}
+	~ControlPoint() { closeJournal(); }
 
+	// appends the points of a journal or of a text file (x y z of position, up and
+	// direction per line), the format is told by the start of the file
 	bool loadPoints(std::string filename);		// return false if file can't load
+	bool exportPoints(std::string filename);	// all points as text
 	bool clearPoints(std::string filename);
-	glm::mat3 addPoint(glm::vec3 pos, glm::vec3 dir, glm::vec3 up, std::string filename);
-	void buildModelMat();
+	// records the point in the journal filename, which stays open for the next points;
+	// a new journal starts with the points already loaded
+	glm::mat3 addPoint(glm::vec3 pos, glm::vec3 up, glm::vec3 dir, std::string filename);
+	bool openJournal(std::string filename);
+	void closeJournal();
+	void buildModelMat();						// model matrices of the points that have none yet
 	glm::mat4 getModelMat(int idx);
 	int getSize();
 	glm::mat3 goToLastPoint();
 
+private:
+	bool loadJournal(std::ifstream &in, std::string filename);
+	bool loadText(std::ifstream &in, std::string filename);
+	bool writeRecord(const glm::mat3 &pt);
+
+	std::string journalName;			// file open in file, empty if none
+	std::string refusedJournal;			// last file openJournal failed on, addPoint does not retry it
 
 };
 
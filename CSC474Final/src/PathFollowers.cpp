@@ -0,0 +1,47 @@
+#include "PathFollowers.h"
+
+using namespace std;
+using namespace glm;
+
+int PathFollowers::addPath(const ArcPath *path) {
+	paths.push_back(path);
+	return paths.size() - 1;
+}
+
+int PathFollowers::add(int path, float d, float v, vec3 o) {
+	pathId.push_back(path);
+	distance.push_back(d);
+	speed.push_back(v);
+	offset.push_back(o);
+	transforms.push_back(mat4(0.0));
+	return pathId.size() - 1;
+}
+
+void PathFollowers::clear() {
+	pathId.clear();
+	distance.clear();
+	speed.clear();
+	offset.clear();
+	transforms.clear();
+}
+
+void PathFollowers::update(float dt) {
+	int count = pathId.size();
+	float *d = distance.data();
+	const float *v = speed.data();
+	for (int i = 0; i < count; i++)
+		d[i] += v[i] * dt;
+
+	for (int i = 0; i < count; i++) {
+		const ArcPath *path = pathId[i] >= 0 && pathId[i] < paths.size() ? paths[pathId[i]] : NULL;
+		if (!path || !path->isValid()) {
+			transforms[i] = mat4(0.0);
+			continue;
+		}
+		d[i] = path->wrap(d[i]);
+		mat4 &m = transforms[i];
+		m = path->frameAt(d[i]);
+		const vec3 &o = offset[i];
+		m[3] += m[0] * o.x + m[1] * o.y + m[2] * o.z;
+	}
+}
@@ -0,0 +1,45 @@
+#pragma  once
+#ifndef PathFollowers_h
+#define PathFollowers_h
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ArcPath.h"
+
+
+/***************************************/
+
+// Everything that flies an ArcPath, each follower with its own distance along its path.
+// The state of the followers is kept in parallel arrays, so update() advances all of
+// them in one pass and writes their frames in order into one array of transforms.
+// Paths are shared by pointer and may be rebuilt between updates, distances wrap to
+// the new length.
+class PathFollowers {
+public:
+	PathFollowers() {}
+	~PathFollowers() {}
+
+	int addPath(const ArcPath *path);		// returns the path id
+	// returns the follower index
+	int add(int path, float distance = 0, float speed = 0, glm::vec3 offset = glm::vec3(0));
+	void clear();
+	int getSize() const { return pathId.size(); }
+
+	// moves every follower by speed * dt and computes its transform
+	void update(float dt);
+	// frame at the distance of follower i, then its offset; zero if its path is not valid
+	const glm::mat4 &getTransform(int i) const { return transforms[i]; }
+	const std::vector<glm::mat4> &getTransforms() const { return transforms; }
+
+	std::vector<int> pathId;
+	std::vector<float> distance;			// along the path
+	std::vector<float> speed;				// distance per second, may be negative
+	std::vector<glm::vec3> offset;			// in the frame of the follower: x side, y up, z along the path
+
+private:
+	std::vector<const ArcPath *> paths;
+	std::vector<glm::mat4> transforms;
+};
+
+#endif /* PathFollowers_h */
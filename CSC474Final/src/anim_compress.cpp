@@ -0,0 +1,104 @@
+#include <cmath>
+#include <algorithm>
+#include "anim_compress.h"
+#include "anim_sampler.h"
+
+using namespace std;
+using namespace glm;
+
+#define QUAT_BITS 15
+#define QUAT_SCALE 16383.5f					// (2^15 - 1) / 2
+#define QUAT_RANGE 0.70710678118654752f		// 1 / sqrt(2)
+
+// the implicit time may be off by this much from the stored timestamp
+#define TIME_TOLERANCE_MS 1.0
+
+static uint64_t quantize_component(float v)
+{
+	float n = std::min(std::max(v / QUAT_RANGE, -1.f), 1.f);
+	return (uint64_t)(n * QUAT_SCALE + QUAT_SCALE + 0.5f);
+}
+
+static float dequantize_component(uint64_t v)
+{
+	return ((float)v - QUAT_SCALE) / QUAT_SCALE * QUAT_RANGE;
+}
+
+void pack_quat(const quat &q, uint16_t out[3])
+{
+	float c[4] = { q.x, q.y, q.z, q.w };
+	int largest = 0;
+	for (int i = 1; i < 4; i++)
+		if (fabs(c[i]) > fabs(c[largest]))
+			largest = i;
+	// q and -q are the same rotation, keep the dropped one positive
+	float sign = c[largest] < 0 ? -1.f : 1.f;
+
+	uint64_t bits = (uint64_t)largest;
+	for (int i = 0; i < 4; i++)
+		if (i != largest)
+			bits = (bits << QUAT_BITS) | quantize_component(c[i] * sign);
+	out[0] = (uint16_t)(bits >> 32);
+	out[1] = (uint16_t)(bits >> 16);
+	out[2] = (uint16_t)bits;
+}
+
+quat unpack_quat(const uint16_t in[3])
+{
+	uint64_t bits = ((uint64_t)in[0] << 32) | ((uint64_t)in[1] << 16) | in[2];
+	int largest = (int)(bits >> (3 * QUAT_BITS)) & 3;
+	float c[4];
+	float sum = 0;
+	for (int i = 3, shift = 0; i >= 0; i--)
+	{
+		if (i == largest) continue;
+		c[i] = dequantize_component((bits >> shift) & ((1 << QUAT_BITS) - 1));
+		sum += c[i] * c[i];
+		shift += QUAT_BITS;
+	}
+	c[largest] = sqrt(std::max(1.f - sum, 0.f));
+	return quat(c[3], c[0], c[1], c[2]);
+}
+
+bool quantize_channel(animation_per_bone &anim)
+{
+	const keyframe_array &keys = anim.keyframes;
+	int n = keys.size();
+	if (is_sparse(anim) || n < 2)
+		return false;
+
+	double start = keys[0].timestamp_ms;
+	double step = (double)(keys[n - 1].timestamp_ms - keys[0].timestamp_ms) / (n - 1);
+	if (step <= 0)
+		return false;
+	for (int i = 0; i < n; i++)
+		if (fabs(keys[i].timestamp_ms - (start + i * step)) > TIME_TOLERANCE_MS)
+			return false;
+
+	packed_track &track = anim.packed;
+	vec3 lo = keys[0].translation, hi = keys[0].translation;
+	for (int i = 1; i < n; i++)
+	{
+		lo = glm::min(lo, keys[i].translation);
+		hi = glm::max(hi, keys[i].translation);
+	}
+	track.start_ms = (float)start;
+	track.step_ms = (float)step;
+	track.trans_min = lo;
+	track.trans_extent = hi - lo;
+
+	track.keys.resize(n);
+	packed_key *out = track.keys.writable();
+	for (int i = 0; i < n; i++)
+	{
+		pack_quat(keys[i].quaternion, out[i].rot);
+		for (int c = 0; c < 3; c++)
+		{
+			float extent = track.trans_extent[c];
+			float u = extent > 0 ? (keys[i].translation[c] - lo[c]) / extent : 0.f;
+			out[i].trans[c] = (uint16_t)(std::min(std::max(u, 0.f), 1.f) * 65535.f + 0.5f);
+		}
+	}
+	anim.keyframes = keyframe_array();
+	return true;
+}
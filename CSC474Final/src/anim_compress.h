@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef LAB474_ANIM_COMPRESS_H_INCLUDED
+#define LAB474_ANIM_COMPRESS_H_INCLUDED
+
+#include "bone.h"
+
+// Quantized clip storage. Rotations are stored smallest three: the largest component is
+// dropped (the sign is flipped so it is positive) and the other three, which lie in
+// [-1/sqrt(2), 1/sqrt(2)], get 15 bits each. Translations get 16 bits per component
+// inside the min/max box of the channel. Key times are implicit, so only channels
+// sampled at a fixed rate (like the 24 fps bake) can be packed.
+
+// packs the keyframes of the channel into anim.packed and frees them. Returns false
+// and leaves the channel as it is if it is sparse, too short or not evenly spaced.
+bool quantize_channel(animation_per_bone &anim);
+
+void pack_quat(const quat &q, uint16_t out[3]);
+quat unpack_quat(const uint16_t in[3]);
+
+inline vec3 unpack_trans(const packed_track &track, const uint16_t in[3])
+{
+	return track.trans_min + track.trans_extent * vec3(in[0], in[1], in[2]) * (1.f / 65535.f);
+}
+
+#endif // LAB474_ANIM_COMPRESS_H_INCLUDED
@@ -0,0 +1,384 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include "anim_file.h"
+
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+#define ANIM_FILE_ALIGN 16
+
+static uint64_t align_up(uint64_t offset)
+{
+	return (offset + ANIM_FILE_ALIGN - 1) & ~(uint64_t)(ANIM_FILE_ALIGN - 1);
+}
+
+// depth first like bone::write_to_VBOs, so the indices match bone::index
+static void flatten(bone *b, int parent, vector<bone*> &order, vector<int> &parents)
+{
+	int index = order.size();
+	order.push_back(b);
+	parents.push_back(parent);
+	for (int i = 0; i < b->kids.size(); i++)
+		flatten(b->kids[i], index, order, parents);
+}
+
+static uint32_t add_string(string &table, const string &s)
+{
+	uint32_t offset = table.size();
+	table.append(s);
+	table.push_back('\0');
+	return offset;
+}
+
+bool save_anim_file(const string &filename, bone *root, const all_animations &anims)
+{
+	vector<bone*> order;
+	vector<int> parents;
+	if (root)
+		flatten(root, -1, order, parents);
+
+	string strings;
+	vector<anim_file_bone> bones(order.size());
+	for (int i = 0; i < order.size(); i++)
+	{
+		anim_file_bone &b = bones[i];
+		memset(&b, 0, sizeof(b));
+		b.name = add_string(strings, order[i]->name);
+		b.parent = parents[i];
+		b.pos[0] = order[i]->pos.x; b.pos[1] = order[i]->pos.y; b.pos[2] = order[i]->pos.z;
+		b.rot[0] = order[i]->q.x; b.rot[1] = order[i]->q.y; b.rot[2] = order[i]->q.z; b.rot[3] = order[i]->q.w;
+	}
+
+	vector<anim_file_channel> channels(anims.animations.size());
+	vector<anim_file_curve> curves;
+	uint64_t key_count = 0, curve_key_count = 0, packed_key_count = 0, motion_key_count = 0;
+	for (int i = 0; i < anims.animations.size(); i++)
+	{
+		const animation_per_bone &anim = anims.animations[i];
+		anim_file_channel &c = channels[i];
+		memset(&c, 0, sizeof(c));
+		c.name = add_string(strings, anim.name);
+		c.bone = add_string(strings, anim.bone);
+		c.frames = anim.frames;
+		c.key_count = anim.keyframes.size();
+		c.duration = anim.duration;
+		c.first_key = key_count;
+		key_count += anim.keyframes.size();
+		const packed_track &track = anim.packed;
+		c.first_packed = packed_key_count;
+		c.packed_count = track.keys.size();
+		c.packed_start_ms = track.start_ms;
+		c.packed_step_ms = track.step_ms;
+		for (int k = 0; k < 3; k++)
+		{
+			c.trans_min[k] = track.trans_min[k];
+			c.trans_extent[k] = track.trans_extent[k];
+		}
+		packed_key_count += track.keys.size();
+		c.first_motion = motion_key_count;
+		c.motion_count = anim.root_motion.size();
+		motion_key_count += anim.root_motion.size();
+		if (anim.curves.size() == CURVE_COUNT)
+		{
+			c.first_curve = curves.size();
+			c.curve_count = CURVE_COUNT;
+			for (int k = 0; k < CURVE_COUNT; k++)
+			{
+				anim_file_curve curve;
+				memset(&curve, 0, sizeof(curve));
+				curve.first_key = curve_key_count;
+				curve.key_count = anim.curves[k].size();
+				curve_key_count += anim.curves[k].size();
+				curves.push_back(curve);
+			}
+		}
+	}
+
+	anim_file_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ANIM_FILE_MAGIC;
+	header.version = ANIM_FILE_VERSION;
+	header.keyframe_size = sizeof(keyframe);
+	header.bone_count = bones.size();
+	header.channel_count = channels.size();
+	header.key_count = key_count;
+	header.bones_offset = align_up(sizeof(header));
+	header.channels_offset = align_up(header.bones_offset + bones.size() * sizeof(anim_file_bone));
+	header.keys_offset = align_up(header.channels_offset + channels.size() * sizeof(anim_file_channel));
+	header.curve_key_size = sizeof(curve_key);
+	header.curve_count = curves.size();
+	header.curve_key_count = curve_key_count;
+	header.curves_offset = align_up(header.keys_offset + key_count * sizeof(keyframe));
+	header.curve_keys_offset = align_up(header.curves_offset + curves.size() * sizeof(anim_file_curve));
+	header.packed_key_count = packed_key_count;
+	header.packed_keys_offset = align_up(header.curve_keys_offset + curve_key_count * sizeof(curve_key));
+	header.motion_key_count = motion_key_count;
+	header.motion_keys_offset = align_up(header.packed_keys_offset + packed_key_count * sizeof(packed_key));
+	header.strings_offset = align_up(header.motion_keys_offset + motion_key_count * sizeof(motion_key));
+	header.strings_size = strings.size();
+
+	ofstream file(filename.c_str(), ios::binary | ios::trunc);
+	if (!file.is_open())
+	{
+		cout << "Error: could not write " << filename << endl;
+		return false;
+	}
+
+	// the gaps before the aligned sections are filled with zeros
+	uint64_t written = 0;
+	const char zeros[ANIM_FILE_ALIGN] = {};
+	file.write((const char *)&header, sizeof(header));
+	written += sizeof(header);
+	file.write(zeros, header.bones_offset - written);
+	file.write((const char *)bones.data(), bones.size() * sizeof(anim_file_bone));
+	written = header.bones_offset + bones.size() * sizeof(anim_file_bone);
+	file.write(zeros, header.channels_offset - written);
+	file.write((const char *)channels.data(), channels.size() * sizeof(anim_file_channel));
+	written = header.channels_offset + channels.size() * sizeof(anim_file_channel);
+	file.write(zeros, header.keys_offset - written);
+	for (int i = 0; i < anims.animations.size(); i++)
+	{
+		const keyframe_array &keys = anims.animations[i].keyframes;
+		// padding bytes of keyframe are copied as they are, the loader never reads them
+		file.write((const char *)keys.data(), keys.size() * sizeof(keyframe));
+	}
+	written = header.keys_offset + key_count * sizeof(keyframe);
+	file.write(zeros, header.curves_offset - written);
+	file.write((const char *)curves.data(), curves.size() * sizeof(anim_file_curve));
+	written = header.curves_offset + curves.size() * sizeof(anim_file_curve);
+	file.write(zeros, header.curve_keys_offset - written);
+	for (int i = 0; i < anims.animations.size(); i++)
+		for (int k = 0; k < anims.animations[i].curves.size(); k++)
+		{
+			const curve_key_array &keys = anims.animations[i].curves[k];
+			file.write((const char *)keys.data(), keys.size() * sizeof(curve_key));
+		}
+	written = header.curve_keys_offset + curve_key_count * sizeof(curve_key);
+	file.write(zeros, header.packed_keys_offset - written);
+	for (int i = 0; i < anims.animations.size(); i++)
+	{
+		const key_array<packed_key> &keys = anims.animations[i].packed.keys;
+		file.write((const char *)keys.data(), keys.size() * sizeof(packed_key));
+	}
+	written = header.packed_keys_offset + packed_key_count * sizeof(packed_key);
+	file.write(zeros, header.motion_keys_offset - written);
+	for (int i = 0; i < anims.animations.size(); i++)
+	{
+		const motion_key_array &keys = anims.animations[i].root_motion;
+		file.write((const char *)keys.data(), keys.size() * sizeof(motion_key));
+	}
+	written = header.motion_keys_offset + motion_key_count * sizeof(motion_key);
+	file.write(zeros, header.strings_offset - written);
+	file.write(strings.data(), strings.size());
+
+	return file.good();
+}
+
+//**************************************************
+
+// true if count items of stride bytes from offset end within total, checked without overflow
+static bool section_fits(uint64_t offset, uint64_t count, uint64_t stride, uint64_t total)
+{
+	return offset <= total && count <= (total - offset) / stride;
+}
+
+bool anim_file::open(const string &filename)
+{
+	close();
+
+#ifdef _WIN32
+	// no mmap, read the whole file into memory instead
+	FILE *file = fopen(filename.c_str(), "rb");
+	if (!file)
+	{
+		cout << "Warning: could not open " << filename << endl;
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char *buffer = length > 0 ? new char[length] : NULL;
+	if (!buffer || fread(buffer, 1, length, file) != (size_t)length)
+	{
+		delete[] buffer;
+		fclose(file);
+		cout << "Warning: could not read " << filename << endl;
+		return false;
+	}
+	fclose(file);
+	data = buffer;
+	size = length;
+	mapped = false;
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		cout << "Warning: could not open " << filename << endl;
+		return false;
+	}
+	struct stat st;
+	void *p = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+	{
+		cout << "Warning: could not map " << filename << endl;
+		return false;
+	}
+	data = (const char *)p;
+	size = st.st_size;
+	mapped = true;
+#endif
+
+	header = (const anim_file_header *)data;
+	bool ok = size >= sizeof(anim_file_header) && header->magic == ANIM_FILE_MAGIC;
+	if (ok && (header->version != ANIM_FILE_VERSION || header->keyframe_size != sizeof(keyframe) || header->curve_key_size != sizeof(curve_key)))
+	{
+		cout << "Warning: " << filename << " was baked by a different version, bake it again" << endl;
+		close();
+		return false;
+	}
+	ok = ok && header->bone_count > 0 && section_fits(header->bones_offset, header->bone_count, sizeof(anim_file_bone), size);
+	ok = ok && section_fits(header->channels_offset, header->channel_count, sizeof(anim_file_channel), size);
+	ok = ok && section_fits(header->keys_offset, header->key_count, sizeof(keyframe), size);
+	ok = ok && section_fits(header->curves_offset, header->curve_count, sizeof(anim_file_curve), size);
+	ok = ok && section_fits(header->curve_keys_offset, header->curve_key_count, sizeof(curve_key), size);
+	ok = ok && section_fits(header->packed_keys_offset, header->packed_key_count, sizeof(packed_key), size);
+	ok = ok && section_fits(header->motion_keys_offset, header->motion_key_count, sizeof(motion_key), size);
+	ok = ok && section_fits(header->strings_offset, header->strings_size, 1, size);
+	ok = ok && header->strings_size > 0 && data[header->strings_offset + header->strings_size - 1] == '\0';
+	if (!ok)
+	{
+		cout << "Warning: " << filename << " is not a valid anim file" << endl;
+		close();
+		return false;
+	}
+
+	bones = (const anim_file_bone *)(data + header->bones_offset);
+	channels = (const anim_file_channel *)(data + header->channels_offset);
+	keys = (const keyframe *)(data + header->keys_offset);
+	curves = (const anim_file_curve *)(data + header->curves_offset);
+	curve_keys = (const curve_key *)(data + header->curve_keys_offset);
+	packed_keys = (const packed_key *)(data + header->packed_keys_offset);
+	motion_keys = (const motion_key *)(data + header->motion_keys_offset);
+	for (int i = 0; i < header->channel_count; i++)
+		if (!section_fits(channels[i].first_key, channels[i].key_count, 1, header->key_count) ||
+			(channels[i].curve_count != 0 && channels[i].curve_count != CURVE_COUNT) ||
+			!section_fits(channels[i].first_curve, channels[i].curve_count, 1, header->curve_count) ||
+			!section_fits(channels[i].first_packed, channels[i].packed_count, 1, header->packed_key_count) ||
+			!section_fits(channels[i].first_motion, channels[i].motion_count, 1, header->motion_key_count) ||
+			channels[i].name >= header->strings_size || channels[i].bone >= header->strings_size)
+		{
+			cout << "Warning: " << filename << " has a broken channel" << endl;
+			close();
+			return false;
+		}
+	for (int i = 0; i < header->curve_count; i++)
+		if (!section_fits(curves[i].first_key, curves[i].key_count, 1, header->curve_key_count))
+		{
+			cout << "Warning: " << filename << " has a broken curve" << endl;
+			close();
+			return false;
+		}
+	// the first bone is the only root, every other one follows its parent
+	for (int i = 0; i < header->bone_count; i++)
+		if (bones[i].parent < (i > 0 ? 0 : -1) || bones[i].parent >= i || bones[i].name >= header->strings_size)
+		{
+			cout << "Warning: " << filename << " has a broken bone" << endl;
+			close();
+			return false;
+		}
+	return true;
+}
+
+void anim_file::close()
+{
+	if (data)
+	{
+#ifdef _WIN32
+		delete[] data;
+#else
+		if (mapped)
+			munmap((void *)data, size);
+		else
+			delete[] data;
+#endif
+	}
+	data = NULL;
+	size = 0;
+	header = NULL;
+	bones = NULL;
+	channels = NULL;
+	keys = NULL;
+	curves = NULL;
+	curve_keys = NULL;
+	packed_keys = NULL;
+	motion_keys = NULL;
+}
+
+const char *anim_file::string_at(uint32_t offset) const
+{
+	return data + header->strings_offset + offset;
+}
+
+bone *anim_file::make_bones() const
+{
+	if (!data || header->bone_count == 0) return NULL;
+
+	vector<bone*> made(header->bone_count);
+	for (int i = 0; i < header->bone_count; i++)
+	{
+		const anim_file_bone &b = bones[i];
+		bone *actual = new bone;
+		actual->name = string_at(b.name);
+		actual->pos = vec3(b.pos[0], b.pos[1], b.pos[2]);
+		actual->q = quat(b.rot[3], b.rot[0], b.rot[1], b.rot[2]);
+		actual->index = i;
+		if (b.parent >= 0)
+		{
+			actual->parent = made[b.parent];
+			made[b.parent]->kids.push_back(actual);
+		}
+		made[i] = actual;
+	}
+	return made[0];
+}
+
+void anim_file::add_clips(all_animations *all_anim) const
+{
+	if (!data) return;
+	all_anim->animations.reserve(all_anim->animations.size() + header->channel_count);
+	for (int i = 0; i < header->channel_count; i++)
+	{
+		const anim_file_channel &c = channels[i];
+		animation_per_bone anim;
+		anim.name = string_at(c.name);
+		anim.bone = string_at(c.bone);
+		anim.duration = c.duration;
+		anim.frames = c.frames;
+		anim.keyframes.map(keys + c.first_key, c.key_count);
+		anim.curves.resize(c.curve_count);
+		for (int k = 0; k < c.curve_count; k++)
+		{
+			const anim_file_curve &curve = curves[c.first_curve + k];
+			anim.curves[k].map(curve_keys + curve.first_key, curve.key_count);
+		}
+		anim.packed.start_ms = c.packed_start_ms;
+		anim.packed.step_ms = c.packed_step_ms;
+		anim.packed.trans_min = vec3(c.trans_min[0], c.trans_min[1], c.trans_min[2]);
+		anim.packed.trans_extent = vec3(c.trans_extent[0], c.trans_extent[1], c.trans_extent[2]);
+		anim.packed.keys.map(packed_keys + c.first_packed, c.packed_count);
+		anim.root_motion.map(motion_keys + c.first_motion, c.motion_count);
+		all_anim->animations.push_back(anim);
+	}
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#ifndef LAB474_ANIM_FILE_H_INCLUDED
+#define LAB474_ANIM_FILE_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "bone.h"
+
+// Baked skeleton and clips, written by the anim_bake tool (tools/anim_bake.cpp) from fbx files
+// and mapped at runtime without the fbx sdk. Layout, all sections 16 byte aligned:
+//   anim_file_header
+//   anim_file_bone[bone_count]        depth first, a parent comes before its kids
+//   anim_file_channel[channel_count]  in the order of all_animations
+//   keyframe[key_count]               raw keys of all channels, used in place
+//   anim_file_curve[curve_count]      CURVE_COUNT per sparse channel
+//   curve_key[curve_key_count]        raw authored keys of all curves, used in place
+//   packed_key[packed_key_count]      quantized keys of all packed channels, used in place
+//   motion_key[motion_key_count]      root motion of all in place channels, used in place
+//   string table                      0 terminated names, referenced by offset
+// The file is written in the byte order of the baking machine, a mismatch fails the magic.
+
+#define ANIM_FILE_MAGIC 0x4d494e41474e5244ULL	// "DRNGANIM"
+#define ANIM_FILE_VERSION 4
+
+struct anim_file_header
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t keyframe_size;		// sizeof(keyframe) of the baker, must match ours
+	uint32_t bone_count;
+	uint32_t channel_count;
+	uint64_t key_count;
+	uint64_t bones_offset;
+	uint64_t channels_offset;
+	uint64_t keys_offset;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint32_t curve_key_size;	// sizeof(curve_key) of the baker, must match ours
+	uint32_t curve_count;
+	uint64_t curve_key_count;
+	uint64_t curves_offset;
+	uint64_t curve_keys_offset;
+	uint64_t packed_key_count;
+	uint64_t packed_keys_offset;
+	uint64_t motion_key_count;
+	uint64_t motion_keys_offset;
+};
+
+struct anim_file_bone
+{
+	uint32_t name;				// offset in the string table
+	int32_t parent;				// index of the parent bone, -1 for the root
+	float pos[3];
+	float rot[4];				// x, y, z, w
+	uint32_t pad;
+};
+
+struct anim_file_channel
+{
+	uint32_t name;				// clip name, offset in the string table
+	uint32_t bone;				// bone name, offset in the string table
+	int32_t frames;
+	uint32_t key_count;
+	int64_t duration;
+	uint64_t first_key;			// index into the keys
+	uint32_t first_curve;		// index into the curves, sparse channels only
+	uint32_t curve_count;		// 0 or CURVE_COUNT
+	uint64_t first_packed;		// index into the packed keys, packed channels only
+	uint32_t packed_count;
+	float packed_start_ms;		// packed_track of the channel
+	float packed_step_ms;
+	float trans_min[3];
+	float trans_extent[3];
+	uint32_t motion_count;		// root motion keys, in place channels only
+	uint64_t first_motion;		// index into the motion keys
+};
+
+struct anim_file_curve
+{
+	uint64_t first_key;			// index into the curve keys
+	uint32_t key_count;
+	uint32_t pad;
+};
+
+// writes the hierarchy below root and all clips, false if the file can't be written
+bool save_anim_file(const string &filename, bone *root, const all_animations &anims);
+
+// A baked file mapped into memory. The keys of the clips handed out by add_clips point
+// into the mapping, so the anim_file has to live as long as the clips are used.
+class anim_file
+{
+public:
+	anim_file() {}
+	~anim_file() { close(); }
+
+	// maps and checks the file, false (with a message) if it is missing or does not match
+	bool open(const string &filename);
+	void close();
+	bool is_open() const { return data != NULL; }
+
+	// new bone tree like readtobone makes it, bone::index numbered depth first
+	bone *make_bones() const;
+	// appends every channel of the file, keyframes, curves and root motion map the file without copying
+	void add_clips(all_animations *all_anim) const;
+
+private:
+	anim_file(const anim_file &);
+	anim_file &operator=(const anim_file &);
+
+	const char *string_at(uint32_t offset) const;
+
+	const char *data = NULL;
+	size_t size = 0;
+	bool mapped = false;			// false: data was read into a heap buffer
+	const anim_file_header *header = NULL;
+	const anim_file_bone *bones = NULL;
+	const anim_file_channel *channels = NULL;
+	const keyframe *keys = NULL;
+	const anim_file_curve *curves = NULL;
+	const curve_key *curve_keys = NULL;
+	const packed_key *packed_keys = NULL;
+	const motion_key *motion_keys = NULL;
+};
+
+#endif // LAB474_ANIM_FILE_H_INCLUDED
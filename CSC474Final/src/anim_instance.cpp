@@ -0,0 +1,193 @@
+#include <algorithm>
+#include "anim_instance.h"
+
+using namespace std;
+using namespace glm;
+
+int instance_pool::add(const blend_tree &prototype)
+{
+	instances.push_back(anim_instance());
+	anim_instance &inst = instances.back();
+	inst.blend = prototype;
+	inst.blend.bind(*skel);
+	inst.pose.bind(*skel);
+	return instances.size() - 1;
+}
+
+int instance_pool::pick_band(const anim_instance &inst) const
+{
+	if (!inst.visible) return -1;
+	if (bands.empty()) return 0;
+	float d = distance(inst.position, viewer);
+	for (int b = 0; b < bands.size(); b++)
+		if (d <= bands[b].max_distance)
+			return b;
+	return bands.size() - 1;
+}
+
+void instance_pool::full_update(anim_instance &inst, int joints)
+{
+	inst.blend.evaluate(*skel, inst.pose, joints);
+	inst.pose.evaluate(*skel, joints);
+
+	int interval = inst.band >= 0 && inst.band < bands.size() ? bands[inst.band].interval : 1;
+	if (interval <= 1)
+	{
+		inst.history = 0;
+		return;
+	}
+	// keep the sample for the frames until the next update
+	inst.prev_rot.x.swap(inst.last_rot.x); inst.prev_rot.y.swap(inst.last_rot.y);
+	inst.prev_rot.z.swap(inst.last_rot.z); inst.prev_rot.w.swap(inst.last_rot.w);
+	inst.prev_trans.x.swap(inst.last_trans.x); inst.prev_trans.y.swap(inst.last_trans.y); inst.prev_trans.z.swap(inst.last_trans.z);
+	inst.last_rot = inst.pose.local_rot;
+	inst.last_trans = inst.pose.local_trans;
+	inst.history = std::min(inst.history + 1, 2);
+	inst.prev_phase = inst.last_phase;
+	inst.last_phase = inst.blend.phase;
+	inst.update_step = inst.since_update;
+	inst.since_update = 0;
+}
+
+void instance_pool::extrapolate(anim_instance &inst, int joints, vector<float> &factor)
+{
+	// without two updates, or after a pause, the pose is held
+	if (inst.history < 2 || inst.update_step <= 0) return;
+	// so it is across the loop of synced clips, the end and the start don't line up
+	if (inst.blend.sync && (inst.last_phase < inst.prev_phase || inst.blend.phase < inst.last_phase)) return;
+
+	float a = 1 + (float)std::min(inst.since_update / inst.update_step, 1.0);
+	factor.assign(joints, a);
+	batch_slerp(inst.prev_rot, inst.last_rot, &factor[0], inst.pose.local_rot, joints, inst.blend.mode);
+	batch_mix(inst.prev_trans, inst.last_trans, &factor[0], inst.pose.local_trans, joints);
+	inst.pose.mark_all_dirty();
+	inst.pose.evaluate(*skel, joints);
+	// the pose no longer is what the tree sampled last
+	inst.blend.invalidate();
+}
+
+void instance_pool::update(double dt_ms)
+{
+	int count = instances.size();
+	frame++;
+	work.resize(count);
+	if (share_poses)
+	{
+		keys.resize(count);
+		hashes.resize(count);
+	}
+
+	workers->parallel_for(count, [&](int i, int worker)
+	{
+		anim_instance &inst = instances[i];
+		double dt = inst.paused ? 0 : dt_ms * inst.speed;
+		inst.blend.advance(dt);
+		inst.since_update += dt;
+
+		int band = pick_band(inst);
+		int interval = band >= 0 && band < bands.size() ? bands[band].interval : 1;
+		int joints = band < 0 ? 1 : skel->lod_joints(band < bands.size() ? bands[band].lod : 0);
+		bool was_shared = inst.shared >= 0;
+		bool grew = joints > inst.joints;
+		inst.shared = -1;
+		inst.band = band;
+		if (grew)
+		{
+			// the joints past the old count did not follow their parents
+			inst.pose.mark_all_dirty();
+			inst.blend.invalidate();
+			inst.history = 0;
+		}
+		inst.joints = joints;
+
+		if (band < 0)
+		{
+			work[i] = LOD_ROOT;
+			inst.history = 0;
+			return;
+		}
+		if (interval > 1 && !was_shared && !grew && (frame + i) % interval != 0)
+		{
+			work[i] = LOD_EXTRAPOLATE;
+			return;
+		}
+		if (was_shared)
+			inst.history = 0;
+		work[i] = LOD_FULL;
+		if (share_poses && interval <= 1)
+		{
+			work[i] = LOD_FULL_SHARED;
+			hashes[i] = inst.blend.pose_key(weight_step, keys[i], joints);
+		}
+	}, batch);
+
+	// the first instance with a key evaluates, the later ones point to it
+	for (int b = 0; b < bands.size(); b++)
+		bands[b].instances = bands[b].updates = bands[b].extrapolated = 0;
+	offscreen = 0;
+	poses_evaluated = 0;
+	jobs.clear();
+	next_leader.assign(count, -1);
+	first_leader.clear();
+	for (int i = 0; i < count; i++)
+	{
+		int band = instances[i].band;
+		lod_band *counter = band >= 0 && band < bands.size() ? &bands[band] : NULL;
+		if (counter)
+			counter->instances++;
+
+		if (work[i] == LOD_FULL_SHARED)
+		{
+			unordered_map<uint64_t, int>::iterator it = first_leader.find(hashes[i]);
+			if (it == first_leader.end())
+				first_leader[hashes[i]] = i;
+			else
+			{
+				int l = it->second;
+				while (keys[l] != keys[i] && next_leader[l] >= 0)
+					l = next_leader[l];
+				if (keys[l] == keys[i])
+				{
+					instances[i].shared = l;
+					work[i] = LOD_NONE;
+					continue;
+				}
+				next_leader[l] = i;
+			}
+		}
+
+		if (work[i] == LOD_FULL || work[i] == LOD_FULL_SHARED)
+		{
+			poses_evaluated++;
+			if (counter)
+				counter->updates++;
+		}
+		else if (work[i] == LOD_EXTRAPOLATE && counter)
+			counter->extrapolated++;
+		else if (work[i] == LOD_ROOT)
+			offscreen++;
+		jobs.push_back(i);
+	}
+
+	factors.resize(workers->size());
+	workers->parallel_for(jobs.size(), [&](int j, int worker)
+	{
+		anim_instance &inst = instances[jobs[j]];
+		switch (work[jobs[j]])
+		{
+		case LOD_FULL:
+		case LOD_FULL_SHARED:
+			full_update(inst, inst.joints);
+			break;
+		case LOD_EXTRAPOLATE:
+			extrapolate(inst, inst.joints, factors[worker]);
+			break;
+		case LOD_ROOT:
+			inst.blend.evaluate(*skel, inst.pose, 1);
+			inst.pose.evaluate(*skel, 1);
+			break;
+		default:
+			break;
+		}
+	}, batch);
+}
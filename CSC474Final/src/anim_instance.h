@@ -0,0 +1,124 @@
+#pragma once
+
+#ifndef LAB474_ANIM_INSTANCE_H_INCLUDED
+#define LAB474_ANIM_INSTANCE_H_INCLUDED
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "skeleton.h"
+#include "blend_tree.h"
+#include "thread_pool.h"
+
+// One animated copy of a skeleton: its own blend state and playback time (in blend)
+// and its own pose and palette. Skeleton and clips are shared and only read.
+struct anim_instance
+{
+	blend_tree blend;
+	skeleton_pose pose;
+	float speed = 1;			// playback rate
+	bool paused = false;
+	int shared = -1;			// instance whose pose this one shows since the last update, -1 for its own
+
+	// level of detail, set before every update
+	vec3 position = vec3(0);
+	bool visible = true;		// off screen instances only sample the root
+	int band = 0;				// lod band of the last update, -1 for off screen
+	int joints = 0;				// joints evaluated by the last update, see skeleton::lod_size
+
+	// the last two full updates of a band with a reduced rate, the frames between them
+	// extrapolate from these
+	quat_stream prev_rot, last_rot;
+	vec3_stream prev_trans, last_trans;
+	int history = 0;			// valid samples in last and prev
+	double prev_phase = 0, last_phase = 0;	// blend_tree::phase of the samples
+	double since_update = 0;	// playback ms since the last full update
+	double update_step = 0;		// playback ms between the last two full updates
+};
+
+// Distance band of the temporal level of detail. An instance up to max_distance from
+// the viewer that is in no nearer band is fully updated every interval frames; the
+// instances of a band take turns, so each frame updates about 1 / interval of them.
+// The frames between extrapolate every joint from the last two updates. On top of that
+// the band only evaluates the joints of skeleton lod level lod.
+struct lod_band
+{
+	float max_distance;
+	int interval;
+	int lod;
+
+	lod_band(float max_distance = 0, int interval = 1, int lod = 0) : max_distance(max_distance), interval(interval), lod(lod) {}
+
+	// counters of the last update
+	int instances = 0;
+	int updates = 0;			// full evaluations, without the instances that shared a pose
+	int extrapolated = 0;
+};
+
+// All instances of one skeleton, updated in parallel batches on a thread pool.
+// With share_poses every update first groups the instances by blend_tree::pose_key,
+// only the first instance of a group evaluates and the others show its pose. Instances
+// whose trees use the same blend_tree::quantum_ms then share a pose whenever they are
+// in the same sample tick with the same weights. Only instances of bands with interval 1
+// share, the others need their own pose to extrapolate from.
+class instance_pool
+{
+public:
+	int batch = 32;				// instances per job, the unit the workers steal
+	bool share_poses = true;
+	float weight_step = 1.f / 64;	// blend weights closer than this count as the same
+	int poses_evaluated = 0;	// distinct poses of the last update
+
+	// nearest first, the last one also takes everything farther. Without bands every
+	// visible instance updates every frame.
+	std::vector<lod_band> bands;
+	vec3 viewer = vec3(0);
+	int offscreen = 0;			// root only updates of the last update
+
+	instance_pool(const skeleton &skel, thread_pool &workers) : skel(&skel), workers(&workers) {}
+
+	// new instance playing a copy of prototype, returns its index
+	int add(const blend_tree &prototype);
+	void clear() { instances.clear(); }
+	int size() const { return (int)instances.size(); }
+	anim_instance &operator[](int i) { return instances[i]; }
+	const anim_instance &operator[](int i) const { return instances[i]; }
+	// the pose instance i shows, its own or the one it shares
+	const skeleton_pose &pose(int i) const { int s = instances[i].shared; return instances[s >= 0 ? s : i].pose; }
+	// skeleton lod level instance i was evaluated at, its first joints(i) joints are valid
+	int lod(int i) const { int b = instances[i].band; return b >= 0 && b < bands.size() ? bands[b].lod : 0; }
+	int joints(int i) const { int s = instances[i].shared; return instances[s >= 0 ? s : i].joints; }
+
+	// advances every instance by dt_ms times its speed and updates its pose as its band says
+	void update(double dt_ms);
+
+private:
+	enum lod_work
+	{
+		LOD_NONE,				// shares a pose or holds it
+		LOD_FULL,
+		LOD_FULL_SHARED,		// full, unless an instance with the same key does it
+		LOD_EXTRAPOLATE,
+		LOD_ROOT
+	};
+
+	int pick_band(const anim_instance &inst) const;
+	void full_update(anim_instance &inst, int joints);
+	void extrapolate(anim_instance &inst, int joints, std::vector<float> &factor);
+
+	const skeleton *skel;
+	thread_pool *workers;
+	std::vector<anim_instance> instances;
+	unsigned frame = 0;
+
+	// per update, kept to reuse the memory
+	std::vector<unsigned char> work;
+	std::vector<std::vector<int> > keys;
+	std::vector<uint64_t> hashes;
+	std::vector<int> jobs;					// instances with work to do
+	std::vector<int> next_leader;			// next leader with the same hash, -1 at the end
+	std::unordered_map<uint64_t, int> first_leader;
+	std::vector<std::vector<float> > factors;	// extrapolation factor per joint, per worker
+};
+
+#endif // LAB474_ANIM_INSTANCE_H_INCLUDED
@@ -0,0 +1,29 @@
+#include "anim_motion.h"
+#include "anim_sampler.h"
+
+using namespace std;
+using namespace glm;
+
+bool extract_root_motion(animation_per_bone &anim)
+{
+	if (is_sparse(anim) || is_packed(anim) || anim.keyframes.size() < 2) return false;
+
+	int n = anim.keyframes.size();
+	vector<keyframe> keys(anim.keyframes.begin(), anim.keyframes.end());
+	vec3 start = keys[0].translation;
+	long long start_ms = keys[0].timestamp_ms;
+
+	anim.root_motion.resize(n);
+	motion_key *motion = anim.root_motion.writable();
+	for (int k = 0; k < n; k++)
+	{
+		motion[k].time_ms = (float)(keys[k].timestamp_ms - start_ms);
+		motion[k].offset = vec3(keys[k].translation.x - start.x, 0, keys[k].translation.z - start.z);
+		keys[k].translation.x = start.x;
+		keys[k].translation.z = start.z;
+	}
+
+	anim.keyframes.resize(n);
+	copy(keys.begin(), keys.end(), anim.keyframes.writable());
+	return true;
+}
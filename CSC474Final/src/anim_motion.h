@@ -0,0 +1,20 @@
+#pragma once
+
+#ifndef LAB474_ANIM_MOTION_H_INCLUDED
+#define LAB474_ANIM_MOTION_H_INCLUDED
+
+#include "bone.h"
+
+// Offline root motion extraction. The horizontal (x, z) translation of the root channel is
+// moved into animation_per_bone::root_motion as offsets from the first key, and the keys
+// keep the x and z of the first key, so the clip plays in place and keeps its height. At
+// runtime blend_tree::advance turns the curve into the root delta of every update (see
+// root_motion_delta in anim_sampler.h), the owner of the instance moves it by that.
+// The offsets are in the space of the parent of the bone, the model for the skeleton root.
+
+// extracts the root motion of a sampled channel, the keys are owned afterwards even if they
+// were mapped. Returns false and leaves the channel as it is if it is sparse, packed or
+// shorter than two keys.
+bool extract_root_motion(animation_per_bone &anim);
+
+#endif // LAB474_ANIM_MOTION_H_INCLUDED
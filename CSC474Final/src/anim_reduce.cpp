@@ -0,0 +1,192 @@
+#include <cmath>
+#include <algorithm>
+#include "anim_reduce.h"
+#include "anim_sampler.h"
+#include "anim_compress.h"
+
+using namespace std;
+using namespace glm;
+
+static bool reducible(const animation_per_bone *ch)
+{
+	return ch && !is_sparse(*ch) && !is_packed(*ch) && ch->keyframes.size() > 2;
+}
+
+static mat4 local_matrix(const quat &q, const vec3 &tr)
+{
+	return translate(mat4(1), tr) * mat4_cast(q);
+}
+
+// local transform of joint j at the key time time_ms as the blend tree samples it.
+// sample_channel takes the time from the start of the channel, and the end of the
+// clip holds its last key here instead of wrapping to the first.
+static mat4 sample_local(const skeleton &skel, int clip, int j, double time_ms)
+{
+	animation_per_bone *ch = skel.channel(clip, j);
+	if (!ch || (!is_sparse(*ch) && !is_packed(*ch) && ch->keyframes.size() < 2))
+		return local_matrix(quat(1, 0, 0, 0), skel.rest_trans[j]);
+	double local = time_ms - channel_start_ms(*ch), length = channel_length_ms(*ch);
+	if (length > 0 && local >= length)
+	{
+		if (is_packed(*ch))
+			return local_matrix(unpack_quat(ch->packed.keys.back().rot), unpack_trans(ch->packed, ch->packed.keys.back().trans));
+		if (is_sparse(*ch))
+		{
+			const curve_key_array *c = &ch->curves[0];
+			double end = channel_start_ms(*ch) + length;
+			return local_matrix(euler_to_quat(evaluate_curve(c[CURVE_RX], end), evaluate_curve(c[CURVE_RY], end), evaluate_curve(c[CURVE_RZ], end)),
+				vec3(evaluate_curve(c[CURVE_TX], end), evaluate_curve(c[CURVE_TY], end), evaluate_curve(c[CURVE_TZ], end)));
+		}
+		return local_matrix(ch->keyframes.back().quaternion, ch->keyframes.back().translation);
+	}
+	int cursor = 0;
+	quat q;
+	vec3 tr;
+	sample_channel(*ch, local, cursor, q, tr);
+	return local_matrix(q, tr);
+}
+
+static float angle_between(const mat4 &a, const mat4 &b)
+{
+	quat qa = normalize(quat_cast(mat3(a))), qb = normalize(quat_cast(mat3(b)));
+	float d = std::min(fabs(dot(qa, qb)), 1.f);
+	return degrees(2.f * acos(d));
+}
+
+// model space of all joints at every frame, [frame * joints + joint]
+static void evaluate_frames(const skeleton &skel, int clip, const vector<double> &times, vector<mat4> &world)
+{
+	int n = skel.size();
+	world.resize(times.size() * n);
+	for (int f = 0; f < times.size(); f++)
+		for (int j = 0; j < n; j++)
+		{
+			mat4 M = sample_local(skel, clip, j, times[f]);
+			world[f * n + j] = skel.parent[j] < 0 ? M : world[f * n + skel.parent[j]] * M;
+		}
+}
+
+reduce_report reduce_clip(const skeleton &skel, int clip, float pos_tolerance, float angle_tolerance)
+{
+	reduce_report report;
+	int n = skel.size();
+	if (clip < 0 || clip >= skel.clip_count || n == 0)
+		return report;
+
+	// the frames to check are the keys of the longest channel, the 24 fps bake keys them all alike
+	int longest = -1;
+	for (int j = 0; j < n; j++)
+	{
+		animation_per_bone *ch = skel.channel(clip, j);
+		if (ch && !is_sparse(*ch) && !is_packed(*ch))
+		{
+			report.keys_before += ch->keyframes.size();
+			if (longest < 0 || ch->keyframes.size() > skel.channel(clip, longest)->keyframes.size())
+				longest = j;
+		}
+	}
+	report.keys_after = report.keys_before;
+	if (longest < 0)
+		return report;
+	vector<double> times;
+	const keyframe_array &frame_keys = skel.channel(clip, longest)->keyframes;
+	for (int k = 0; k < frame_keys.size(); k++)
+		times.push_back((double)frame_keys[k].timestamp_ms);
+	int frames = times.size();
+
+	vector<mat4> reference, current;
+	evaluate_frames(skel, clip, times, reference);
+	current = reference;
+
+	// joints come parents first but subtrees are not contiguous (see skeleton::build),
+	// so the subtree of every joint is collected: a joint is in it if its parent is
+	vector<int> subtree;
+	vector<unsigned char> in_subtree(n);
+	vector<mat4> relative;
+	for (int j = 0; j < n; j++)
+	{
+		animation_per_bone *ch = skel.channel(clip, j);
+		if (!reducible(ch))
+			continue;
+		const keyframe_array &keys = ch->keyframes;
+		int count = keys.size();
+		subtree.assign(1, j);
+		std::fill(in_subtree.begin(), in_subtree.end(), 0);
+		in_subtree[j] = 1;
+		for (int d = j + 1; d < n; d++)
+			if (skel.parent[d] >= 0 && in_subtree[skel.parent[d]])
+			{
+				in_subtree[d] = 1;
+				subtree.push_back(d);
+			}
+		int size = subtree.size();
+
+		// pose of the subtree relative to j, it does not change while j is reduced
+		relative.resize(frames * size);
+		for (int f = 0; f < frames; f++)
+		{
+			mat4 inv = inverse(current[f * n + j]);
+			for (int s = 0; s < size; s++)
+				relative[f * size + s] = inv * current[f * n + subtree[s]];
+		}
+
+		// greedy: from every kept key, extend the segment as far as the error allows
+		vector<keyframe> kept;
+		kept.push_back(keys[0]);
+		int anchor = 0;
+		while (anchor < count - 1)
+		{
+			int end = anchor + 1;
+			while (end + 1 < count)
+			{
+				int candidate = end + 1;
+				const keyframe &a = keys[anchor], &b = keys[candidate];
+				bool ok = true;
+				for (int f = 0; f < frames && ok; f++)
+				{
+					double t = times[f];
+					if (t <= a.timestamp_ms || t >= b.timestamp_ms) continue;
+					float s = (float)((t - a.timestamp_ms) / (double)(b.timestamp_ms - a.timestamp_ms));
+					mat4 M = local_matrix(slerp(a.quaternion, b.quaternion, s), mix(a.translation, b.translation, s));
+					mat4 W = skel.parent[j] < 0 ? M : current[f * n + skel.parent[j]] * M;
+					for (int s = 0; s < size && ok; s++)
+					{
+						mat4 Wd = W * relative[f * size + s];
+						const mat4 &R = reference[f * n + subtree[s]];
+						ok = length(vec3(Wd[3]) - vec3(R[3])) <= pos_tolerance && angle_between(Wd, R) <= angle_tolerance;
+					}
+				}
+				if (!ok) break;
+				end = candidate;
+			}
+			kept.push_back(keys[end]);
+			anchor = end;
+		}
+
+		if (kept.size() < count)
+		{
+			report.keys_after -= count - kept.size();
+			ch->keyframes.resize(kept.size());
+			std::copy(kept.begin(), kept.end(), ch->keyframes.writable());
+
+			// the reduced joint moves its subtree for the joints that follow
+			for (int f = 0; f < frames; f++)
+			{
+				mat4 M = sample_local(skel, clip, j, times[f]);
+				current[f * n + j] = skel.parent[j] < 0 ? M : current[f * n + skel.parent[j]] * M;
+				for (int s = 1; s < size; s++)
+					current[f * n + subtree[s]] = current[f * n + j] * relative[f * size + s];
+			}
+		}
+	}
+
+	// measure what is left against the original clip
+	for (int f = 0; f < frames; f++)
+		for (int j = 0; j < n; j++)
+		{
+			const mat4 &W = current[f * n + j], &R = reference[f * n + j];
+			report.worst_pos = std::max(report.worst_pos, length(vec3(W[3]) - vec3(R[3])));
+			report.worst_angle = std::max(report.worst_angle, angle_between(W, R));
+		}
+	return report;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#ifndef LAB474_ANIM_REDUCE_H_INCLUDED
+#define LAB474_ANIM_REDUCE_H_INCLUDED
+
+#include <string>
+#include "skeleton.h"
+
+// Offline key reduction of the sampled channels of one clip. Joints are reduced in
+// parent order; a key is dropped when interpolating over it keeps the model space
+// pose of the joint and of every joint below it within the tolerances at all frames
+// of the original clip. The already reduced parents are part of the check, so the
+// error does not add up down the hierarchy.
+
+struct reduce_report
+{
+	int keys_before = 0;
+	int keys_after = 0;
+	float worst_pos = 0;		// largest model space position error of any joint and frame
+	float worst_angle = 0;		// largest model space rotation error in degrees
+};
+
+// pos_tolerance in model units, angle_tolerance in degrees. Sparse and packed channels are
+// left alone, the keys of reduced channels are owned afterwards even if they were mapped.
+reduce_report reduce_clip(const skeleton &skel, int clip, float pos_tolerance, float angle_tolerance);
+
+#endif // LAB474_ANIM_REDUCE_H_INCLUDED
@@ -0,0 +1,219 @@
+#include <cmath>
+#include <algorithm>
+#include "anim_sampler.h"
+#include "anim_compress.h"
+
+using namespace std;
+using namespace glm;
+
+// keys the cursor may walk forward before we give up and search
+#define CURSOR_STEPS 4
+
+static bool key_before(double time_ms, const keyframe &key)
+{
+	return time_ms < key.timestamp_ms;
+}
+
+static bool curve_key_before(double time_ms, const curve_key &key)
+{
+	return time_ms < key.time_ms;
+}
+
+static bool motion_key_before(double time_ms, const motion_key &key)
+{
+	return time_ms < key.time_ms;
+}
+
+double channel_start_ms(const animation_per_bone &anim)
+{
+	if (is_packed(anim)) return anim.packed.start_ms;
+	if (is_sparse(anim) || anim.keyframes.empty()) return 0;
+	return (double)anim.keyframes.front().timestamp_ms;
+}
+
+double channel_length_ms(const animation_per_bone &anim)
+{
+	if (is_sparse(anim)) return (double)std::max(anim.duration, 0LL);
+	if (is_packed(anim)) return (double)anim.packed.step_ms * (anim.packed.keys.size() - 1);
+	if (anim.keyframes.size() < 2) return 0;
+	return (double)(anim.keyframes.back().timestamp_ms - anim.keyframes.front().timestamp_ms);
+}
+
+static double wrap_time(const animation_per_bone &anim, double time_ms)
+{
+	double start = channel_start_ms(anim), length = channel_length_ms(anim);
+	double local = start;
+	if (length > 0)
+	{
+		local = fmod(time_ms, length);
+		if (local < 0) local += length;
+		local += start;
+	}
+	return local;
+}
+
+int find_key(const animation_per_bone &anim, double time_ms, int &cursor, float &t)
+{
+	const keyframe_array &keys = anim.keyframes;
+	int n = keys.size();
+	t = 0;
+	if (n < 2)
+	{
+		cursor = 0;
+		return 0;
+	}
+
+	double local = wrap_time(anim, time_ms);
+
+	int k = std::min(std::max(cursor, 0), n - 2);
+	if (keys[k].timestamp_ms <= local)
+	{
+		for (int step = 0; step < CURSOR_STEPS && k < n - 2 && keys[k + 1].timestamp_ms <= local; step++)
+			k++;
+	}
+	if (keys[k].timestamp_ms > local || (k < n - 2 && keys[k + 1].timestamp_ms <= local))
+	{
+		k = upper_bound(keys.begin(), keys.end(), local, key_before) - keys.begin() - 1;
+		k = std::min(std::max(k, 0), n - 2);
+	}
+	cursor = k;
+
+	double span = (double)(keys[k + 1].timestamp_ms - keys[k].timestamp_ms);
+	if (span > 0)
+		t = (float)std::min(std::max((local - keys[k].timestamp_ms) / span, 0.0), 1.0);
+	return k;
+}
+
+int find_packed_key(const animation_per_bone &anim, double time_ms, float &t)
+{
+	const packed_track &track = anim.packed;
+	int n = track.keys.size();
+	t = 0;
+	if (n < 2 || track.step_ms <= 0)
+		return 0;
+
+	double u = (wrap_time(anim, time_ms) - track.start_ms) / track.step_ms;
+	int k = std::min(std::max((int)floor(u), 0), n - 2);
+	t = (float)std::min(std::max(u - k, 0.0), 1.0);
+	return k;
+}
+
+void unpack_keys(const animation_per_bone &anim, int k, quat &q0, quat &q1, vec3 &t0, vec3 &t1)
+{
+	const packed_track &track = anim.packed;
+	const packed_key &a = track.keys[k], &b = track.keys[k + 1];
+	q0 = unpack_quat(a.rot);
+	q1 = unpack_quat(b.rot);
+	t0 = unpack_trans(track, a.trans);
+	t1 = unpack_trans(track, b.trans);
+}
+
+void sample_channel(const animation_per_bone &anim, double time_ms, int &cursor, quat &q, vec3 &tr)
+{
+	if (is_packed(anim))
+	{
+		if (anim.packed.keys.size() < 2)
+		{
+			q = unpack_quat(anim.packed.keys[0].rot);
+			tr = unpack_trans(anim.packed, anim.packed.keys[0].trans);
+			return;
+		}
+		float t;
+		quat q0, q1;
+		vec3 t0, t1;
+		unpack_keys(anim, find_packed_key(anim, time_ms, t), q0, q1, t0, t1);
+		q = slerp(q0, q1, t);
+		tr = mix(t0, t1, t);
+		return;
+	}
+	if (is_sparse(anim))
+	{
+		double local = wrap_time(anim, time_ms);
+		tr = vec3(evaluate_curve(anim.curves[CURVE_TX], local), evaluate_curve(anim.curves[CURVE_TY], local), evaluate_curve(anim.curves[CURVE_TZ], local));
+		q = euler_to_quat(evaluate_curve(anim.curves[CURVE_RX], local), evaluate_curve(anim.curves[CURVE_RY], local), evaluate_curve(anim.curves[CURVE_RZ], local));
+		return;
+	}
+	if (anim.keyframes.empty())
+		return;
+	float t;
+	int k = find_key(anim, time_ms, cursor, t);
+	if (anim.keyframes.size() < 2)
+	{
+		q = anim.keyframes[0].quaternion;
+		tr = anim.keyframes[0].translation;
+		return;
+	}
+	const keyframe &a = anim.keyframes[k], &b = anim.keyframes[k + 1];
+	q = slerp(a.quaternion, b.quaternion, t);
+	tr = mix(a.translation, b.translation, t);
+}
+
+//**************************************************
+
+vec3 sample_root_motion(const animation_per_bone &anim, double time_ms)
+{
+	const motion_key_array &keys = anim.root_motion;
+	int n = keys.size();
+	if (n == 0) return vec3(0);
+	if (n < 2) return keys[0].offset;
+
+	double local = wrap_time(anim, time_ms) - channel_start_ms(anim);
+	int k = upper_bound(keys.begin(), keys.end(), local, motion_key_before) - keys.begin() - 1;
+	k = std::min(std::max(k, 0), n - 2);
+	const motion_key &a = keys[k], &b = keys[k + 1];
+	float span = b.time_ms - a.time_ms;
+	float t = span > 0 ? (float)std::min(std::max((local - a.time_ms) / span, 0.0), 1.0) : 0.f;
+	return mix(a.offset, b.offset, t);
+}
+
+vec3 root_motion_delta(const animation_per_bone &anim, double from_ms, double to_ms)
+{
+	if (anim.root_motion.empty()) return vec3(0);
+	vec3 delta = sample_root_motion(anim, to_ms) - sample_root_motion(anim, from_ms);
+	double length = channel_length_ms(anim);
+	if (length > 0)
+	{
+		// every pass over the end of the clip adds the way of one loop
+		double loops = floor(to_ms / length) - floor(from_ms / length);
+		delta += (float)loops * anim.root_motion.back().offset;
+	}
+	return delta;
+}
+
+//**************************************************
+
+float evaluate_curve(const curve_key_array &keys, double local_ms)
+{
+	int n = keys.size();
+	if (n == 0) return 0;
+	if (local_ms <= keys[0].time_ms) return keys[0].value;
+	if (local_ms >= keys[n - 1].time_ms) return keys[n - 1].value;
+
+	int k = upper_bound(keys.begin(), keys.end(), local_ms, curve_key_before) - keys.begin() - 1;
+	k = std::min(std::max(k, 0), n - 2);
+	const curve_key &a = keys[k], &b = keys[k + 1];
+	float span = b.time_ms - a.time_ms;
+	if (a.interp == CURVE_CONSTANT || span <= 0)
+		return a.value;
+	float t = (float)(local_ms - a.time_ms) / span;
+	if (a.interp == CURVE_LINEAR)
+		return a.value + (b.value - a.value) * t;
+
+	// cubic hermite, the slopes are per ms so they scale with the segment
+	float t2 = t * t, t3 = t2 * t;
+	return (2 * t3 - 3 * t2 + 1) * a.value + (t3 - 2 * t2 + t) * span * a.slope_out +
+		(-2 * t3 + 3 * t2) * b.value + (t3 - t2) * span * b.slope_in;
+}
+
+quat euler_to_quat(float rx, float ry, float rz)
+{
+	// xyz euler in degrees to the negated quaternion CalcTransRotAnim stores
+	float e1 = rx * 3.141592654 / 180, e2 = ry * 3.141592654 / 180, e3 = rz * 3.141592654 / 180;
+	float c1 = cos(e1 / 2), s1 = sin(e1 / 2), c2 = cos(e2 / 2), s2 = sin(e2 / 2), c3 = cos(e3 / 2), s3 = sin(e3 / 2);
+	quat q;
+	q.w = -(c1 * c2 * c3 + s1 * s2 * s3);
+	q.x = -(s1 * c2 * c3 - c1 * s2 * s3);
+	q.y = -(c1 * s2 * c3 + s1 * c2 * s3);
+	q.z = -(c1 * c2 * s3 - s1 * s2 * c3);
+	return q;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef LAB474_ANIM_SAMPLER_H_INCLUDED
+#define LAB474_ANIM_SAMPLER_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include "bone.h"
+
+// Time based sampling of the keyframes of one channel (one bone of one clip).
+// Every caller keeps an int cursor per channel, the key found by the last call.
+// Sequential playback then only steps the cursor forward, jumps and loops
+// fall back to a binary search over keyframe::timestamp_ms.
+// Sparse channels (animation_per_bone::curves) are evaluated from their authored
+// keys instead; their curves are short, so they are always searched.
+
+// true if the channel holds authored curves instead of sampled keys
+inline bool is_sparse(const animation_per_bone &anim) { return anim.curves.size() == CURVE_COUNT; }
+// true if the keys are quantized into animation_per_bone::packed (see anim_compress.h)
+inline bool is_packed(const animation_per_bone &anim) { return !anim.packed.keys.empty(); }
+
+// first and last timestamp of the channel, the clip loops in between.
+// Sparse channels loop over 0..animation_per_bone::duration.
+double channel_start_ms(const animation_per_bone &anim);
+double channel_length_ms(const animation_per_bone &anim);
+
+// wraps time_ms into the clip and returns the key before it; t is the factor towards the next key.
+// Only for sampled channels.
+int find_key(const animation_per_bone &anim, double time_ms, int &cursor, float &t);
+// the same for packed channels, the key follows from the time without a search
+int find_packed_key(const animation_per_bone &anim, double time_ms, float &t);
+// decodes the packed keys k and k + 1
+void unpack_keys(const animation_per_bone &anim, int k, quat &q0, quat &q1, vec3 &t0, vec3 &t1);
+
+// looped sample of rotation and translation at time_ms
+void sample_channel(const animation_per_bone &anim, double time_ms, int &cursor, quat &q, vec3 &tr);
+
+// offset of the extracted root motion at time_ms, looped, 0 for channels without one
+vec3 sample_root_motion(const animation_per_bone &anim, double time_ms);
+// way of the root motion from from_ms to to_ms, times not wrapped so that every loop in
+// between counts
+vec3 root_motion_delta(const animation_per_bone &anim, double from_ms, double to_ms);
+
+// value of one curve at local_ms, held constant before the first and after the last key
+float evaluate_curve(const curve_key_array &keys, double local_ms);
+// the rotation of LclRotation euler angles in degrees, the same conversion the baker uses
+quat euler_to_quat(float rx, float ry, float rz);
+
+#endif // LAB474_ANIM_SAMPLER_H_INCLUDED
@@ -0,0 +1,406 @@
+#include <cmath>
+#include <glm/simd/platform.h>
+#include "anim_simd.h"
+
+using namespace std;
+using namespace glm;
+
+// below this angle between two quats slerp falls back to a plain lerp
+#define SLERP_LINEAR_DOT (1.f - 1e-5f)
+
+//**************************************************
+// scalar reference, used for the tail lanes and for builds without SSE
+
+static void slerp_lane(const quat_stream &a, const quat_stream &b, float t, quat_stream &out, int i, interp_mode mode)
+{
+	quat qa = a.get(i), qb = b.get(i);
+	if (mode == INTERP_SLERP)
+	{
+		out.set(i, slerp(qa, qb, t));
+		return;
+	}
+	if (dot(qa, qb) < 0)
+		qb = -qb;
+	quat q(mix(qa.w, qb.w, t), mix(qa.x, qb.x, t), mix(qa.y, qb.y, t), mix(qa.z, qb.z, t));
+	out.set(i, normalize(q));
+}
+
+static void mix_lane(const vec3_stream &a, const vec3_stream &b, float t, vec3_stream &out, int i)
+{
+	out.x[i] = a.x[i] + (b.x[i] - a.x[i]) * t;
+	out.y[i] = a.y[i] + (b.y[i] - a.y[i]) * t;
+	out.z[i] = a.z[i] + (b.z[i] - a.z[i]) * t;
+}
+
+static void accumulate_lane(const quat_stream &q, float w, quat_stream &acc, int i)
+{
+	if (q.x[i] * acc.x[i] + q.y[i] * acc.y[i] + q.z[i] * acc.z[i] + q.w[i] * acc.w[i] < 0)
+		w = -w;
+	acc.x[i] += q.x[i] * w;
+	acc.y[i] += q.y[i] * w;
+	acc.z[i] += q.z[i] * w;
+	acc.w[i] += q.w[i] * w;
+}
+
+static void normalize_lane(quat_stream &q, int i)
+{
+	float len = sqrt(q.x[i] * q.x[i] + q.y[i] * q.y[i] + q.z[i] * q.z[i] + q.w[i] * q.w[i]);
+	if (len <= 0)
+	{
+		q.set(i, quat(1, 0, 0, 0));
+		return;
+	}
+	q.x[i] /= len; q.y[i] /= len; q.z[i] /= len; q.w[i] /= len;
+}
+
+static void additive_lane(const quat_stream &ref, const quat_stream &q, float w, quat_stream &acc, int i)
+{
+	quat d = conjugate(ref.get(i)) * q.get(i);
+	if (d.w < 0)
+		d = -d;
+	quat scaled = normalize(quat(1 - w + w * d.w, w * d.x, w * d.y, w * d.z));
+	acc.set(i, acc.get(i) * scaled);
+}
+
+//**************************************************
+// lane types, the kernels are written once against this small interface
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+struct sse_lanes
+{
+	typedef __m128 type;
+	enum { width = 4 };
+	static type load(const float *p) { return _mm_loadu_ps(p); }
+	static void store(float *p, type v) { _mm_storeu_ps(p, v); }
+	static type set1(float f) { return _mm_set1_ps(f); }
+	static type add(type a, type b) { return _mm_add_ps(a, b); }
+	static type sub(type a, type b) { return _mm_sub_ps(a, b); }
+	static type mul(type a, type b) { return _mm_mul_ps(a, b); }
+	static type div(type a, type b) { return _mm_div_ps(a, b); }
+	static type sqrt(type a) { return _mm_sqrt_ps(a); }
+	static type max(type a, type b) { return _mm_max_ps(a, b); }
+	static type and_(type a, type b) { return _mm_and_ps(a, b); }
+	static type xor_(type a, type b) { return _mm_xor_ps(a, b); }
+	static type gt(type a, type b) { return _mm_cmpgt_ps(a, b); }
+	static type lt(type a, type b) { return _mm_cmplt_ps(a, b); }
+	// mask ? b : a
+	static type select(type a, type b, type mask) { return _mm_or_ps(_mm_andnot_ps(mask, a), _mm_and_ps(mask, b)); }
+};
+#endif
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+struct avx_lanes
+{
+	typedef __m256 type;
+	enum { width = 8 };
+	static type load(const float *p) { return _mm256_loadu_ps(p); }
+	static void store(float *p, type v) { _mm256_storeu_ps(p, v); }
+	static type set1(float f) { return _mm256_set1_ps(f); }
+	static type add(type a, type b) { return _mm256_add_ps(a, b); }
+	static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+	static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+	static type div(type a, type b) { return _mm256_div_ps(a, b); }
+	static type sqrt(type a) { return _mm256_sqrt_ps(a); }
+	static type max(type a, type b) { return _mm256_max_ps(a, b); }
+	static type and_(type a, type b) { return _mm256_and_ps(a, b); }
+	static type xor_(type a, type b) { return _mm256_xor_ps(a, b); }
+	static type gt(type a, type b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static type lt(type a, type b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static type select(type a, type b, type mask) { return _mm256_blendv_ps(a, b, mask); }
+};
+typedef avx_lanes lanes;
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+typedef sse_lanes lanes;
+#endif
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#define ANIM_SIMD_KERNELS
+#endif
+
+#ifdef ANIM_SIMD_KERNELS
+
+// acos for x in [0,1], Abramowitz & Stegun 4.4.46, |error| < 2e-8
+template <class L> static typename L::type acos01(typename L::type x)
+{
+	typename L::type p = L::set1(-0.0012624911f);
+	p = L::add(L::mul(p, x), L::set1(0.0066700901f));
+	p = L::add(L::mul(p, x), L::set1(-0.0170881256f));
+	p = L::add(L::mul(p, x), L::set1(0.0308918810f));
+	p = L::add(L::mul(p, x), L::set1(-0.0501743046f));
+	p = L::add(L::mul(p, x), L::set1(0.0889789874f));
+	p = L::add(L::mul(p, x), L::set1(-0.2145988016f));
+	p = L::add(L::mul(p, x), L::set1(1.5707963050f));
+	return L::mul(p, L::sqrt(L::max(L::sub(L::set1(1.f), x), L::set1(0.f))));
+}
+
+// sin for x in [0,pi/2], Taylor series up to x^11
+template <class L> static typename L::type sin0pi2(typename L::type x)
+{
+	typename L::type x2 = L::mul(x, x);
+	typename L::type p = L::set1(-1.f / 39916800.f);
+	p = L::add(L::mul(p, x2), L::set1(1.f / 362880.f));
+	p = L::add(L::mul(p, x2), L::set1(-1.f / 5040.f));
+	p = L::add(L::mul(p, x2), L::set1(1.f / 120.f));
+	p = L::add(L::mul(p, x2), L::set1(-1.f / 6.f));
+	p = L::add(L::mul(p, x2), L::set1(1.f));
+	return L::mul(p, x);
+}
+
+// sin for x in [-pi,pi], folded onto [0,pi/2]; slerp weights leave [0,1] when extrapolating
+template <class L> static typename L::type sin_pi(typename L::type x)
+{
+	typename L::type sign = L::and_(x, L::set1(-0.f));
+	typename L::type ax = L::xor_(x, sign);
+	ax = L::select(ax, L::sub(L::set1(3.14159265f), ax), L::gt(ax, L::set1(1.57079633f)));
+	return L::xor_(sin0pi2<L>(ax), sign);
+}
+
+template <class L> static int slerp_kernel(const quat_stream &a, const quat_stream &b, const float *t, quat_stream &out, int count, interp_mode mode)
+{
+	typedef typename L::type V;
+	const V signbit = L::set1(-0.f), one = L::set1(1.f);
+	int i = 0;
+	for (; i + L::width <= count; i += L::width)
+	{
+		V ax = L::load(&a.x[i]), ay = L::load(&a.y[i]), az = L::load(&a.z[i]), aw = L::load(&a.w[i]);
+		V bx = L::load(&b.x[i]), by = L::load(&b.y[i]), bz = L::load(&b.z[i]), bw = L::load(&b.w[i]);
+		V tt = L::load(t + i);
+
+		// shortest path: flip b where the dot product is negative
+		V d = L::add(L::add(L::mul(ax, bx), L::mul(ay, by)), L::add(L::mul(az, bz), L::mul(aw, bw)));
+		V sign = L::and_(d, signbit);
+		d = L::xor_(d, sign);
+		bx = L::xor_(bx, sign); by = L::xor_(by, sign); bz = L::xor_(bz, sign); bw = L::xor_(bw, sign);
+
+		V wa = L::sub(one, tt), wb = tt;
+		if (mode == INTERP_SLERP)
+		{
+			V angle = acos01<L>(d);
+			V inv = L::div(one, sin0pi2<L>(angle));
+			V sa = L::mul(sin_pi<L>(L::mul(wa, angle)), inv);
+			V sb = L::mul(sin_pi<L>(L::mul(wb, angle)), inv);
+			V linear = L::gt(d, L::set1(SLERP_LINEAR_DOT));
+			wa = L::select(sa, wa, linear);
+			wb = L::select(sb, wb, linear);
+		}
+
+		V rx = L::add(L::mul(ax, wa), L::mul(bx, wb));
+		V ry = L::add(L::mul(ay, wa), L::mul(by, wb));
+		V rz = L::add(L::mul(az, wa), L::mul(bz, wb));
+		V rw = L::add(L::mul(aw, wa), L::mul(bw, wb));
+		if (mode == INTERP_NLERP)
+		{
+			V len = L::sqrt(L::add(L::add(L::mul(rx, rx), L::mul(ry, ry)), L::add(L::mul(rz, rz), L::mul(rw, rw))));
+			V inv = L::div(one, len);
+			rx = L::mul(rx, inv); ry = L::mul(ry, inv); rz = L::mul(rz, inv); rw = L::mul(rw, inv);
+		}
+		L::store(&out.x[i], rx); L::store(&out.y[i], ry); L::store(&out.z[i], rz); L::store(&out.w[i], rw);
+	}
+	return i;
+}
+
+template <class L> static int mix_kernel(const vec3_stream &a, const vec3_stream &b, const float *t, vec3_stream &out, int count)
+{
+	typedef typename L::type V;
+	int i = 0;
+	for (; i + L::width <= count; i += L::width)
+	{
+		V tt = L::load(t + i);
+		V ax = L::load(&a.x[i]), ay = L::load(&a.y[i]), az = L::load(&a.z[i]);
+		L::store(&out.x[i], L::add(ax, L::mul(L::sub(L::load(&b.x[i]), ax), tt)));
+		L::store(&out.y[i], L::add(ay, L::mul(L::sub(L::load(&b.y[i]), ay), tt)));
+		L::store(&out.z[i], L::add(az, L::mul(L::sub(L::load(&b.z[i]), az), tt)));
+	}
+	return i;
+}
+
+template <class L> static int accumulate_kernel(const quat_stream &q, const float *w, quat_stream &acc, int count)
+{
+	typedef typename L::type V;
+	const V signbit = L::set1(-0.f);
+	int i = 0;
+	for (; i + L::width <= count; i += L::width)
+	{
+		V qx = L::load(&q.x[i]), qy = L::load(&q.y[i]), qz = L::load(&q.z[i]), qw = L::load(&q.w[i]);
+		V ax = L::load(&acc.x[i]), ay = L::load(&acc.y[i]), az = L::load(&acc.z[i]), aw = L::load(&acc.w[i]);
+		V d = L::add(L::add(L::mul(qx, ax), L::mul(qy, ay)), L::add(L::mul(qz, az), L::mul(qw, aw)));
+		V ww = L::xor_(L::load(w + i), L::and_(d, signbit));
+		L::store(&acc.x[i], L::add(ax, L::mul(qx, ww)));
+		L::store(&acc.y[i], L::add(ay, L::mul(qy, ww)));
+		L::store(&acc.z[i], L::add(az, L::mul(qz, ww)));
+		L::store(&acc.w[i], L::add(aw, L::mul(qw, ww)));
+	}
+	return i;
+}
+
+template <class L> static int accumulate_kernel(const vec3_stream &v, const float *w, vec3_stream &acc, int count)
+{
+	typedef typename L::type V;
+	int i = 0;
+	for (; i + L::width <= count; i += L::width)
+	{
+		V ww = L::load(w + i);
+		L::store(&acc.x[i], L::add(L::load(&acc.x[i]), L::mul(L::load(&v.x[i]), ww)));
+		L::store(&acc.y[i], L::add(L::load(&acc.y[i]), L::mul(L::load(&v.y[i]), ww)));
+		L::store(&acc.z[i], L::add(L::load(&acc.z[i]), L::mul(L::load(&v.z[i]), ww)));
+	}
+	return i;
+}
+
+template <class L> static int normalize_kernel(quat_stream &q, int count)
+{
+	typedef typename L::type V;
+	const V one = L::set1(1.f), zero = L::set1(0.f), tiny = L::set1(1e-30f);
+	int i = 0;
+	for (; i + L::width <= count; i += L::width)
+	{
+		V qx = L::load(&q.x[i]), qy = L::load(&q.y[i]), qz = L::load(&q.z[i]), qw = L::load(&q.w[i]);
+		V len2 = L::add(L::add(L::mul(qx, qx), L::mul(qy, qy)), L::add(L::mul(qz, qz), L::mul(qw, qw)));
+		V empty = L::lt(len2, tiny);
+		V inv = L::div(one, L::sqrt(L::max(len2, tiny)));
+		L::store(&q.x[i], L::select(L::mul(qx, inv), zero, empty));
+		L::store(&q.y[i], L::select(L::mul(qy, inv), zero, empty));
+		L::store(&q.z[i], L::select(L::mul(qz, inv), zero, empty));
+		L::store(&q.w[i], L::select(L::mul(qw, inv), one, empty));
+	}
+	return i;
+}
+
+template <class L> static int additive_kernel(const quat_stream &ref, const quat_stream &q, const float *w, quat_stream &acc, int count)
+{
+	typedef typename L::type V;
+	const V signbit = L::set1(-0.f), one = L::set1(1.f);
+	int i = 0;
+	for (; i + L::width <= count; i += L::width)
+	{
+		V rx = L::load(&ref.x[i]), ry = L::load(&ref.y[i]), rz = L::load(&ref.z[i]), rw = L::load(&ref.w[i]);
+		V qx = L::load(&q.x[i]), qy = L::load(&q.y[i]), qz = L::load(&q.z[i]), qw = L::load(&q.w[i]);
+
+		// d = conjugate(r) * q
+		V dw = L::add(L::mul(rw, qw), L::add(L::add(L::mul(rx, qx), L::mul(ry, qy)), L::mul(rz, qz)));
+		V dx = L::sub(L::sub(L::mul(rw, qx), L::mul(qw, rx)), L::sub(L::mul(ry, qz), L::mul(rz, qy)));
+		V dy = L::sub(L::sub(L::mul(rw, qy), L::mul(qw, ry)), L::sub(L::mul(rz, qx), L::mul(rx, qz)));
+		V dz = L::sub(L::sub(L::mul(rw, qz), L::mul(qw, rz)), L::sub(L::mul(rx, qy), L::mul(ry, qx)));
+
+		// nlerp from the identity along the shortest path
+		V sign = L::and_(dw, signbit);
+		V ww = L::load(w + i);
+		V sw = L::add(L::sub(one, ww), L::mul(ww, L::xor_(dw, sign)));
+		V sx = L::mul(ww, L::xor_(dx, sign)), sy = L::mul(ww, L::xor_(dy, sign)), sz = L::mul(ww, L::xor_(dz, sign));
+		V inv = L::div(one, L::sqrt(L::add(L::add(L::mul(sx, sx), L::mul(sy, sy)), L::add(L::mul(sz, sz), L::mul(sw, sw)))));
+		sx = L::mul(sx, inv); sy = L::mul(sy, inv); sz = L::mul(sz, inv); sw = L::mul(sw, inv);
+
+		// acc = acc * s
+		V ax = L::load(&acc.x[i]), ay = L::load(&acc.y[i]), az = L::load(&acc.z[i]), aw = L::load(&acc.w[i]);
+		L::store(&acc.w[i], L::sub(L::mul(aw, sw), L::add(L::add(L::mul(ax, sx), L::mul(ay, sy)), L::mul(az, sz))));
+		L::store(&acc.x[i], L::add(L::add(L::mul(aw, sx), L::mul(sw, ax)), L::sub(L::mul(ay, sz), L::mul(az, sy))));
+		L::store(&acc.y[i], L::add(L::add(L::mul(aw, sy), L::mul(sw, ay)), L::sub(L::mul(az, sx), L::mul(ax, sz))));
+		L::store(&acc.z[i], L::add(L::add(L::mul(aw, sz), L::mul(sw, az)), L::sub(L::mul(ax, sy), L::mul(ay, sx))));
+	}
+	return i;
+}
+
+template <class L> static int additive_kernel(const vec3_stream &ref, const vec3_stream &v, const float *w, vec3_stream &acc, int count)
+{
+	typedef typename L::type V;
+	int i = 0;
+	for (; i + L::width <= count; i += L::width)
+	{
+		V ww = L::load(w + i);
+		L::store(&acc.x[i], L::add(L::load(&acc.x[i]), L::mul(L::sub(L::load(&v.x[i]), L::load(&ref.x[i])), ww)));
+		L::store(&acc.y[i], L::add(L::load(&acc.y[i]), L::mul(L::sub(L::load(&v.y[i]), L::load(&ref.y[i])), ww)));
+		L::store(&acc.z[i], L::add(L::load(&acc.z[i]), L::mul(L::sub(L::load(&v.z[i]), L::load(&ref.z[i])), ww)));
+	}
+	return i;
+}
+
+#endif // ANIM_SIMD_KERNELS
+
+//**************************************************
+
+void batch_slerp(const quat_stream &a, const quat_stream &b, const float *t, quat_stream &out, int count, interp_mode mode)
+{
+	int i = 0;
+#ifdef ANIM_SIMD_KERNELS
+	i = slerp_kernel<lanes>(a, b, t, out, count, mode);
+#endif
+	for (; i < count; i++)
+		slerp_lane(a, b, t[i], out, i, mode);
+}
+
+void batch_mix(const vec3_stream &a, const vec3_stream &b, const float *t, vec3_stream &out, int count)
+{
+	int i = 0;
+#ifdef ANIM_SIMD_KERNELS
+	i = mix_kernel<lanes>(a, b, t, out, count);
+#endif
+	for (; i < count; i++)
+		mix_lane(a, b, t[i], out, i);
+}
+
+void batch_accumulate(const quat_stream &q, const float *w, quat_stream &acc, int count)
+{
+	int i = 0;
+#ifdef ANIM_SIMD_KERNELS
+	i = accumulate_kernel<lanes>(q, w, acc, count);
+#endif
+	for (; i < count; i++)
+		accumulate_lane(q, w[i], acc, i);
+}
+
+void batch_accumulate(const vec3_stream &v, const float *w, vec3_stream &acc, int count)
+{
+	int i = 0;
+#ifdef ANIM_SIMD_KERNELS
+	i = accumulate_kernel<lanes>(v, w, acc, count);
+#endif
+	for (; i < count; i++)
+	{
+		acc.x[i] += v.x[i] * w[i];
+		acc.y[i] += v.y[i] * w[i];
+		acc.z[i] += v.z[i] * w[i];
+	}
+}
+
+void batch_normalize(quat_stream &q, int count)
+{
+	int i = 0;
+#ifdef ANIM_SIMD_KERNELS
+	i = normalize_kernel<lanes>(q, count);
+#endif
+	for (; i < count; i++)
+		normalize_lane(q, i);
+}
+
+void batch_additive(const quat_stream &ref, const quat_stream &q, const float *w, quat_stream &acc, int count)
+{
+	int i = 0;
+#ifdef ANIM_SIMD_KERNELS
+	i = additive_kernel<lanes>(ref, q, w, acc, count);
+#endif
+	for (; i < count; i++)
+		additive_lane(ref, q, w[i], acc, i);
+}
+
+void batch_additive(const vec3_stream &ref, const vec3_stream &v, const float *w, vec3_stream &acc, int count)
+{
+	int i = 0;
+#ifdef ANIM_SIMD_KERNELS
+	i = additive_kernel<lanes>(ref, v, w, acc, count);
+#endif
+	for (; i < count; i++)
+	{
+		acc.x[i] += (v.x[i] - ref.x[i]) * w[i];
+		acc.y[i] += (v.y[i] - ref.y[i]) * w[i];
+		acc.z[i] += (v.z[i] - ref.z[i]) * w[i];
+	}
+}
+
+int batch_width()
+{
+#ifdef ANIM_SIMD_KERNELS
+	return lanes::width;
+#else
+	return 1;
+#endif
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#ifndef LAB474_ANIM_SIMD_H_INCLUDED
+#define LAB474_ANIM_SIMD_H_INCLUDED
+
+#include <vector>
+#include <algorithm>
+#include <glm/gtc/quaternion.hpp>
+
+// Structure of arrays streams for the pose buffers, one lane per joint. The batch
+// kernels below interpolate them 4 (SSE2) or 8 (AVX) joints at a time, depending on
+// what glm/simd/platform.h detects for the build, and fall back to scalar glm otherwise.
+
+struct quat_stream
+{
+	std::vector<float> x, y, z, w;
+
+	void resize(int n) { x.resize(n, 0.f); y.resize(n, 0.f); z.resize(n, 0.f); w.resize(n, 1.f); }
+	int size() const { return (int)w.size(); }
+	void set(int i, const glm::quat &q) { x[i] = q.x; y[i] = q.y; z[i] = q.z; w[i] = q.w; }
+	glm::quat get(int i) const { return glm::quat(w[i], x[i], y[i], z[i]); }
+	void zero() { std::fill(x.begin(), x.end(), 0.f); std::fill(y.begin(), y.end(), 0.f); std::fill(z.begin(), z.end(), 0.f); std::fill(w.begin(), w.end(), 0.f); }
+};
+
+struct vec3_stream
+{
+	std::vector<float> x, y, z;
+
+	void resize(int n) { x.resize(n, 0.f); y.resize(n, 0.f); z.resize(n, 0.f); }
+	int size() const { return (int)x.size(); }
+	void set(int i, const glm::vec3 &v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+	glm::vec3 get(int i) const { return glm::vec3(x[i], y[i], z[i]); }
+	void zero() { std::fill(x.begin(), x.end(), 0.f); std::fill(y.begin(), y.end(), 0.f); std::fill(z.begin(), z.end(), 0.f); }
+};
+
+enum interp_mode
+{
+	INTERP_SLERP,		// same result as glm::slerp (shortest path, linear for nearly equal quats)
+	INTERP_NLERP		// normalized lerp along the shortest path, cheaper but not constant speed
+};
+
+// out[i] = slerp(a[i], b[i], t[i]) for the first count lanes, out may be a or b.
+// t may be in [-1,2], past 0 or 1 it extrapolates
+void batch_slerp(const quat_stream &a, const quat_stream &b, const float *t, quat_stream &out, int count, interp_mode mode);
+// out[i] = mix(a[i], b[i], t[i]) for the first count lanes, out may be a or b
+void batch_mix(const vec3_stream &a, const vec3_stream &b, const float *t, vec3_stream &out, int count);
+
+// N-way blending: zero the accumulators, add every weighted pose, normalize the rotations.
+// acc[i] += w[i] * q[i], with q[i] flipped into the hemisphere of acc[i]
+void batch_accumulate(const quat_stream &q, const float *w, quat_stream &acc, int count);
+// acc[i] += w[i] * v[i]
+void batch_accumulate(const vec3_stream &v, const float *w, vec3_stream &acc, int count);
+// q[i] = normalize(q[i]), lanes of zero length become the identity
+void batch_normalize(quat_stream &q, int count);
+
+// Additive layers: the difference of a clip to its reference pose is put on top of the
+// blended pose. acc[i] = acc[i] * nlerp(identity, inverse(ref[i]) * q[i], w[i])
+void batch_additive(const quat_stream &ref, const quat_stream &q, const float *w, quat_stream &acc, int count);
+// acc[i] += w[i] * (v[i] - ref[i])
+void batch_additive(const vec3_stream &ref, const vec3_stream &v, const float *w, vec3_stream &acc, int count);
+
+// number of lanes the kernels process per step in this build (1 for the scalar fallback)
+int batch_width();
+
+#endif // LAB474_ANIM_SIMD_H_INCLUDED
@@ -0,0 +1,143 @@
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include "anim_vat.h"
+#include "blend_tree.h"
+
+using namespace std;
+using namespace glm;
+
+void anim_vat::bake(const skeleton &skel, float rate)
+{
+	joints = skel.size();
+	fps = rate;
+	clips.clear();
+	rows.clear();
+	if (joints == 0 || fps <= 0) return;
+
+	// one clip node tree per clip, played at the exact time
+	skeleton_pose pose;
+	pose.bind(skel);
+	for (int c = 0; c < skel.clip_count; c++)
+	{
+		blend_tree tree;
+		tree.root = tree.add_clip(c);
+		tree.sync = false;
+		tree.bind(skel);
+
+		vat_clip clip;
+		memset(&clip, 0, sizeof(clip));
+		clip.first_frame = frame_count();
+		clip.length_ms = skel.clip_length_ms(c);
+		int steps = (int)ceil(clip.length_ms * fps / 1000.0);
+		clip.frames = steps + 1;
+		for (int k = 0; k < clip.frames; k++)
+		{
+			// the last frame is the end of the clip, not the start again, the clip may not be a loop
+			tree.time_ms = steps > 0 ? (double)k * clip.length_ms / steps : 0;
+			if (k == steps && steps > 0)
+				tree.time_ms = clip.length_ms - 1e-3;
+			tree.evaluate(skel, pose);
+			pose.evaluate(skel);
+			rows.insert(rows.end(), pose.palette.begin(), pose.palette.begin() + joints * 3);
+		}
+		clips.push_back(clip);
+	}
+}
+
+bool anim_vat::save(const string &filename) const
+{
+	anim_vat_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ANIM_VAT_MAGIC;
+	header.version = ANIM_VAT_VERSION;
+	header.joints = joints;
+	header.clip_count = clips.size();
+	header.frame_count = frame_count();
+	header.fps = fps;
+
+	ofstream file(filename.c_str(), ios::binary | ios::trunc);
+	if (!file.is_open())
+	{
+		cout << "Error: could not write " << filename << endl;
+		return false;
+	}
+	file.write((const char *)&header, sizeof(header));
+	file.write((const char *)clips.data(), clips.size() * sizeof(vat_clip));
+	file.write((const char *)rows.data(), rows.size() * sizeof(vec4));
+	return file.good();
+}
+
+bool anim_vat::load(const string &filename)
+{
+	ifstream file(filename.c_str(), ios::binary);
+	if (!file.is_open())
+	{
+		cout << "Warning: could not open " << filename << endl;
+		return false;
+	}
+	anim_vat_header header;
+	if (!file.read((char *)&header, sizeof(header)) || header.magic != ANIM_VAT_MAGIC || header.version != ANIM_VAT_VERSION)
+	{
+		cout << "Warning: " << filename << " is not a vertex animation texture of this version" << endl;
+		return false;
+	}
+
+	vector<vat_clip> new_clips(header.clip_count);
+	vector<vec4> new_rows((size_t)header.frame_count * header.joints * 3);
+	file.read((char *)new_clips.data(), new_clips.size() * sizeof(vat_clip));
+	file.read((char *)new_rows.data(), new_rows.size() * sizeof(vec4));
+	if (!file)
+	{
+		cout << "Warning: " << filename << " is cut off" << endl;
+		return false;
+	}
+	for (int c = 0; c < new_clips.size(); c++)
+		if (new_clips[c].frames < 1 || new_clips[c].first_frame < 0 || new_clips[c].first_frame + new_clips[c].frames > (int)header.frame_count)
+		{
+			cout << "Warning: clip " << c << " of " << filename << " is out of range" << endl;
+			return false;
+		}
+
+	joints = header.joints;
+	fps = header.fps;
+	clips.swap(new_clips);
+	rows.swap(new_rows);
+	return true;
+}
+
+//**************************************************
+
+void anim_vat::frame_at(int clip, double time_ms, int &row0, int &row1, float &a) const
+{
+	const vat_clip &c = clips[clip];
+	double f = 0;
+	if (c.length_ms > 0)
+	{
+		f = fmod(time_ms, (double)c.length_ms) / c.length_ms;
+		if (f < 0) f += 1;
+		f *= c.frames - 1;
+	}
+	int k = std::max(std::min((int)f, c.frames - 2), 0);
+	a = c.frames > 1 ? (float)(f - k) : 0.f;
+	row0 = c.first_frame + k;
+	row1 = c.first_frame + std::min(k + 1, c.frames - 1);
+}
+
+mat4 anim_vat::row_matrix(int row, int joint) const
+{
+	const vec4 *r = &rows[((size_t)row * joints + joint) * 3];
+	return transpose(mat4(r[0], r[1], r[2], vec4(0, 0, 0, 1)));
+}
+
+mat4 anim_vat::sample(int clip, double time_ms, int joint) const
+{
+	// same as the shader: the texels are mixed, not the rotations
+	int row0, row1;
+	float a;
+	frame_at(clip, time_ms, row0, row1, a);
+	const vec4 *r0 = &rows[((size_t)row0 * joints + joint) * 3];
+	const vec4 *r1 = &rows[((size_t)row1 * joints + joint) * 3];
+	return transpose(mat4(mix(r0[0], r1[0], a), mix(r0[1], r1[1], a), mix(r0[2], r1[2], a), vec4(0, 0, 0, 1)));
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#ifndef LAB474_ANIM_VAT_H_INCLUDED
+#define LAB474_ANIM_VAT_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "skeleton.h"
+
+// Vertex animation texture: the palette of every clip sampled at a fixed rate, so the
+// vertex shader can play a clip from nothing but the instance time. One texture row per
+// frame, 3 RGBA32F texels per joint (in skeleton order) in the layout of skeleton_pose::palette. A clip of
+// length L has n + 1 frames at k * L / n, the last one is the end of the clip.
+// File layout, written by the vat_bake tool (tools/vat_bake.cpp):
+//   anim_vat_header
+//   vat_clip[clip_count]
+//   vec4[frame_count * joints * 3]     the rows, frame by frame
+
+#define ANIM_VAT_MAGIC 0x5441565f474e5244ULL	// "DRNG_VAT"
+#define ANIM_VAT_VERSION 1
+
+struct anim_vat_header
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t joints;
+	uint32_t clip_count;
+	uint32_t frame_count;
+	float fps;
+	uint32_t pad;
+};
+
+struct vat_clip
+{
+	int32_t first_frame;		// texture row of frame 0
+	int32_t frames;				// rows, including the end of the clip
+	float length_ms;
+	uint32_t pad;
+};
+
+class anim_vat
+{
+public:
+	int joints = 0;
+	float fps = 0;
+	std::vector<vat_clip> clips;
+	std::vector<vec4> rows;				// [(frame * joints + joint) * 3 + row]
+
+	// samples every clip of the skeleton at about fps frames per second
+	void bake(const skeleton &skel, float fps);
+	// false (with a message) if the file can't be written or read or does not match
+	bool save(const std::string &filename) const;
+	bool load(const std::string &filename);
+
+	int frame_count() const { return joints > 0 ? (int)rows.size() / (joints * 3) : 0; }
+	// texture row and fraction to the next row of the clip at time_ms, looping
+	void frame_at(int clip, double time_ms, int &row0, int &row1, float &a) const;
+	// CPU reference of the shader fetch: world matrix of the joint at time_ms
+	mat4 sample(int clip, double time_ms, int joint) const;
+	// the baked matrix of the joint in a texture row
+	mat4 row_matrix(int row, int joint) const;
+};
+
+#endif // LAB474_ANIM_VAT_H_INCLUDED
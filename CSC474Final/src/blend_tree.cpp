@@ -0,0 +1,520 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "blend_tree.h"
+#include "anim_sampler.h"
+#include "anim_compress.h"
+
+using namespace std;
+using namespace glm;
+
+int blend_tree::add_param(float value)
+{
+	params.push_back(value);
+	return params.size() - 1;
+}
+
+int blend_tree::add_clip(int clip)
+{
+	blend_node node;
+	node.type = BLEND_CLIP;
+	node.clip = clip;
+	nodes.push_back(node);
+	return nodes.size() - 1;
+}
+
+int blend_tree::add_blend(const vector<int> &children, const vector<float> &weights)
+{
+	blend_node node;
+	node.type = BLEND_WEIGHTED;
+	node.children = children;
+	node.weights = weights;
+	node.weights.resize(children.size(), 0.f);
+	node.masks.assign(children.size(), -1);
+	nodes.push_back(node);
+	return nodes.size() - 1;
+}
+
+int blend_tree::add_blend1d(int param, const vector<int> &children, const vector<float> &thresholds)
+{
+	blend_node node;
+	node.type = BLEND_1D;
+	node.param_x = param;
+	node.children = children;
+	node.weights.assign(children.size(), 0.f);
+	node.masks.assign(children.size(), -1);
+	for (int i = 0; i < children.size(); i++)
+		node.positions.push_back(vec2(i < thresholds.size() ? thresholds[i] : 0.f, 0.f));
+	nodes.push_back(node);
+	return nodes.size() - 1;
+}
+
+int blend_tree::add_blend2d(int paramx, int paramy, const vector<int> &children, const vector<vec2> &positions)
+{
+	blend_node node;
+	node.type = BLEND_2D;
+	node.param_x = paramx;
+	node.param_y = paramy;
+	node.children = children;
+	node.weights.assign(children.size(), 0.f);
+	node.masks.assign(children.size(), -1);
+	node.positions = positions;
+	node.positions.resize(children.size(), vec2(0));
+	nodes.push_back(node);
+	return nodes.size() - 1;
+}
+
+int blend_tree::add_mask(const vector<float> &joint_weights)
+{
+	masks.push_back(joint_weights);
+	return masks.size() - 1;
+}
+
+void blend_tree::set_mask(int node, int child, int mask)
+{
+	nodes[node].masks[child] = mask;
+}
+
+int blend_tree::add_layer(int clip, float weight, int mask, double ref_ms)
+{
+	blend_layer layer;
+	layer.clip = clip;
+	layer.weight = weight;
+	layer.mask = mask;
+	layer.ref_ms = ref_ms;
+	layers.push_back(layer);
+	return layers.size() - 1;
+}
+
+//**************************************************
+
+void blend_tree::bind(const skeleton &skel)
+{
+	joints = skel.size();
+	if (root < 0 && !nodes.empty())
+		root = nodes.size() - 1;
+
+	leaf_of_node.assign(nodes.size(), -1);
+	leaf_clip.clear();
+	leaf_length.clear();
+	leaf_motion.clear();
+	for (int n = 0; n < nodes.size(); n++)
+		if (nodes[n].type == BLEND_CLIP)
+		{
+			leaf_of_node[n] = leaf_clip.size();
+			leaf_clip.push_back(nodes[n].clip);
+			bool valid = nodes[n].clip >= 0 && nodes[n].clip < skel.clip_count;
+			leaf_length.push_back(valid ? skel.clip_length_ms(nodes[n].clip) : 0);
+			leaf_motion.push_back(valid ? skel.root_motion(nodes[n].clip) : NULL);
+		}
+	for (int m = 0; m < masks.size(); m++)
+		masks[m].resize(joints, 1.f);
+
+	int leaves = leaf_clip.size();
+	leaf_scalar.assign(leaves, 0.f);
+	leaf_w.assign(leaves * joints, 0.f);
+	node_w.assign(nodes.size() * joints, 0.f);
+	cursors.assign(leaves * joints, 0);
+
+	q0 = quat_stream(); q1 = quat_stream(); qacc = quat_stream();
+	t0 = vec3_stream(); t1 = vec3_stream(); tacc = vec3_stream();
+	q0.resize(joints); q1.resize(joints); qacc.resize(joints);
+	t0.resize(joints); t1.resize(joints); tacc.resize(joints);
+	f.assign(joints, 0.f);
+
+	// the reference poses are sampled once, the layers only subtract them
+	layer_cursors.assign(layers.size() * joints, 0);
+	layer_ref_rot.assign(layers.size(), quat_stream());
+	layer_ref_trans.assign(layers.size(), vec3_stream());
+	for (int l = 0; l < layers.size(); l++)
+	{
+		if (layers[l].clip < 0 || layers[l].clip >= skel.clip_count) continue;
+		sample_clip(skel, layers[l].clip, layers[l].ref_ms, &layer_cursors[l * joints], joints);
+		layer_ref_rot[l] = q0;
+		layer_ref_trans[l] = t0;
+	}
+	layer_w.assign(joints, 0.f);
+	cached = false;
+}
+
+void blend_tree::update_weights(blend_node &node)
+{
+	int n = node.children.size();
+	if (n == 0) return;
+
+	if (node.type == BLEND_1D)
+	{
+		float v = node.param_x >= 0 ? params[node.param_x] : 0;
+		fill(node.weights.begin(), node.weights.end(), 0.f);
+		if (v <= node.positions[0].x)
+			node.weights[0] = 1;
+		else if (v >= node.positions[n - 1].x)
+			node.weights[n - 1] = 1;
+		else
+			for (int i = 0; i < n - 1; i++)
+				if (v < node.positions[i + 1].x)
+				{
+					float span = node.positions[i + 1].x - node.positions[i].x;
+					float a = span > 0 ? (v - node.positions[i].x) / span : 0;
+					node.weights[i] = 1 - a;
+					node.weights[i + 1] = a;
+					break;
+				}
+	}
+	else if (node.type == BLEND_2D)
+	{
+		vec2 p(node.param_x >= 0 ? params[node.param_x] : 0, node.param_y >= 0 ? params[node.param_y] : 0);
+		float sum = 0;
+		for (int i = 0; i < n; i++)
+		{
+			vec2 d = p - node.positions[i];
+			float d2 = dot(d, d);
+			if (d2 < 1e-8f)
+			{
+				// right on a sample
+				fill(node.weights.begin(), node.weights.end(), 0.f);
+				node.weights[i] = 1;
+				return;
+			}
+			node.weights[i] = 1.f / d2;
+			sum += node.weights[i];
+		}
+		for (int i = 0; i < n; i++)
+			node.weights[i] /= sum;
+	}
+}
+
+void blend_tree::propagate_scalar(int node, float w)
+{
+	blend_node &nd = nodes[node];
+	if (nd.type == BLEND_CLIP)
+	{
+		leaf_scalar[leaf_of_node[node]] += w;
+		return;
+	}
+	float sum = 0;
+	for (int i = 0; i < nd.children.size(); i++)
+		sum += nd.weights[i];
+	if (sum <= 0) return;
+	for (int i = 0; i < nd.children.size(); i++)
+		if (nd.weights[i] > 0)
+			propagate_scalar(nd.children[i], w * nd.weights[i] / sum);
+}
+
+// node_w of node is set, pushes it down to the children, masks renormalize per joint
+void blend_tree::propagate(int node)
+{
+	blend_node &nd = nodes[node];
+	const float *in = &node_w[node * joints];
+	if (nd.type == BLEND_CLIP)
+	{
+		float *out = &leaf_w[leaf_of_node[node] * joints];
+		for (int j = 0; j < joints; j++)
+			out[j] += in[j];
+		return;
+	}
+
+	int n = nd.children.size();
+	bool masked = false;
+	float sum_unmasked = 0;
+	for (int i = 0; i < n; i++)
+	{
+		masked = masked || nd.masks[i] >= 0;
+		sum_unmasked += nd.weights[i];
+	}
+	if (sum_unmasked <= 0) return;
+
+	for (int j = 0; j < joints; j++)
+	{
+		float sum = sum_unmasked;
+		if (masked)
+		{
+			sum = 0;
+			for (int i = 0; i < n; i++)
+				sum += nd.weights[i] * (nd.masks[i] >= 0 ? masks[nd.masks[i]][j] : 1.f);
+		}
+		for (int i = 0; i < n; i++)
+		{
+			if (nd.weights[i] <= 0) continue;
+			float w = nd.weights[i] / sum_unmasked;
+			// a joint masked out of every child keeps the unmasked weights
+			if (masked && sum > 0)
+				w = nd.weights[i] * (nd.masks[i] >= 0 ? masks[nd.masks[i]][j] : 1.f) / sum;
+			node_w[nd.children[i] * joints + j] = in[j] * w;
+		}
+	}
+	for (int i = 0; i < n; i++)
+		if (nd.weights[i] > 0)
+			propagate(nd.children[i]);
+}
+
+void blend_tree::update()
+{
+	for (int n = 0; n < nodes.size(); n++)
+		update_weights(nodes[n]);
+	fill(leaf_scalar.begin(), leaf_scalar.end(), 0.f);
+	propagate_scalar(root, 1);
+}
+
+double blend_tree::leaf_time(int leaf) const
+{
+	return snap(sync ? phase * leaf_length[leaf] : time_ms);
+}
+
+void blend_tree::advance(double dt_ms)
+{
+	double from_time = time_ms, from_phase = phase;
+	time_ms += dt_ms;
+	for (int l = 0; l < layers.size(); l++)
+		layers[l].time_ms += dt_ms * layers[l].speed;
+	root_delta = vec3(0);
+	if (root < 0) return;
+	update();
+
+	// synced clips advance by the weighted length of everything that plays
+	double length = 0;
+	for (int l = 0; l < leaf_scalar.size(); l++)
+		length += leaf_scalar[l] * leaf_length[l];
+	double to_phase = from_phase + (length > 0 ? dt_ms / length : 0);
+
+	// the root motion is taken before the phase wraps, so a loop counts
+	for (int l = 0; l < leaf_motion.size(); l++)
+		if (leaf_scalar[l] > 0 && leaf_motion[l])
+		{
+			double from = sync ? from_phase * leaf_length[l] : from_time;
+			double to = sync ? to_phase * leaf_length[l] : time_ms;
+			root_delta += leaf_scalar[l] * root_motion_delta(*leaf_motion[l], from, to);
+		}
+	phase = to_phase - floor(to_phase);
+}
+
+void blend_tree::sample_clip(const skeleton &skel, int clip, double t, int *cursor, int count)
+{
+	for (int j = 0; j < count; j++)
+	{
+		animation_per_bone *ch = clip >= 0 && clip < skel.clip_count ? skel.channel(clip, j) : NULL;
+		if (ch && is_sparse(*ch))
+		{
+			// authored curves give the pose directly, nothing left to interpolate
+			quat q;
+			vec3 tr;
+			sample_channel(*ch, t, cursor[j], q, tr);
+			q0.set(j, q); q1.set(j, q);
+			t0.set(j, tr); t1.set(j, tr);
+			f[j] = 0;
+			continue;
+		}
+		if (ch && is_packed(*ch))
+		{
+			if (ch->packed.keys.size() < 2)
+			{
+				// a static channel holds its only key, like sample_channel
+				quat q = unpack_quat(ch->packed.keys[0].rot);
+				vec3 tr = unpack_trans(ch->packed, ch->packed.keys[0].trans);
+				q0.set(j, q); q1.set(j, q);
+				t0.set(j, tr); t1.set(j, tr);
+				f[j] = 0;
+				continue;
+			}
+			// decoded straight into the interpolation streams
+			quat a, b;
+			vec3 ta, tb;
+			unpack_keys(*ch, find_packed_key(*ch, t, f[j]), a, b, ta, tb);
+			q0.set(j, a); q1.set(j, b);
+			t0.set(j, ta); t1.set(j, tb);
+			continue;
+		}
+		if (!ch || ch->keyframes.empty())
+		{
+			q0.set(j, quat(1, 0, 0, 0)); q1.set(j, quat(1, 0, 0, 0));
+			t0.set(j, skel.rest_trans[j]); t1.set(j, skel.rest_trans[j]);
+			f[j] = 0;
+			continue;
+		}
+		if (ch->keyframes.size() < 2)
+		{
+			// a single key is held, like sample_channel
+			q0.set(j, ch->keyframes[0].quaternion); q1.set(j, ch->keyframes[0].quaternion);
+			t0.set(j, ch->keyframes[0].translation); t1.set(j, ch->keyframes[0].translation);
+			f[j] = 0;
+			continue;
+		}
+		int k = find_key(*ch, t, cursor[j], f[j]);
+		q0.set(j, ch->keyframes[k].quaternion); q1.set(j, ch->keyframes[k + 1].quaternion);
+		t0.set(j, ch->keyframes[k].translation); t1.set(j, ch->keyframes[k + 1].translation);
+	}
+	batch_slerp(q0, q1, &f[0], q0, count, mode);
+	batch_mix(t0, t1, &f[0], t0, count);
+}
+
+void blend_tree::apply_layers(const skeleton &skel, int count)
+{
+	for (int l = 0; l < layers.size(); l++)
+	{
+		const blend_layer &layer = layers[l];
+		if (layer.weight <= 0 || layer.clip < 0 || layer.clip >= skel.clip_count) continue;
+
+		const vector<float> *mask = layer.mask >= 0 && layer.mask < masks.size() ? &masks[layer.mask] : NULL;
+		for (int j = 0; j < count; j++)
+			layer_w[j] = mask ? layer.weight * (*mask)[j] : layer.weight;
+		sample_clip(skel, layer.clip, snap(layer.time_ms), &layer_cursors[l * joints], count);
+		batch_additive(layer_ref_rot[l], q0, &layer_w[0], qacc, count);
+		batch_additive(layer_ref_trans[l], t0, &layer_w[0], tacc, count);
+	}
+}
+
+void blend_tree::evaluate(const skeleton &skel, skeleton_pose &pose, int count)
+{
+	if (root < 0 || joints == 0 || joints != skel.size() || joints != pose.size()) return;
+	if (count <= 0 || count > joints)
+		count = joints;
+	update();
+
+	fill(leaf_w.begin(), leaf_w.end(), 0.f);
+	fill(node_w.begin() + root * joints, node_w.begin() + (root + 1) * joints, 1.f);
+	propagate(root);
+
+	double sample_time = sync ? phase : time_ms;
+	bool same_layers = cached_layers.size() == layers.size() * 2;
+	for (int l = 0; l < layers.size() && same_layers; l++)
+		same_layers = cached_layers[l * 2] == snap(layers[l].time_ms) && cached_layers[l * 2 + 1] == layers[l].weight;
+	if (cached && cached_pose == &pose && cached_time == sample_time && cached_mode == mode && cached_count == count && cached_w == leaf_w && same_layers)
+		return;
+	cached = true;
+	cached_pose = &pose;
+	cached_time = sample_time;
+	cached_mode = mode;
+	cached_count = count;
+	cached_w = leaf_w;
+	cached_layers.resize(layers.size() * 2);
+	for (int l = 0; l < layers.size(); l++)
+	{
+		cached_layers[l * 2] = snap(layers[l].time_ms);
+		cached_layers[l * 2 + 1] = layers[l].weight;
+	}
+
+	qacc.zero();
+	tacc.zero();
+	for (int l = 0; l < leaf_clip.size(); l++)
+	{
+		if (leaf_scalar[l] <= 0) continue;
+
+		sample_clip(skel, leaf_clip[l], leaf_time(l), &cursors[l * joints], count);
+		batch_accumulate(q0, &leaf_w[l * joints], qacc, count);
+		batch_accumulate(t0, &leaf_w[l * joints], tacc, count);
+	}
+	// a joint no leaf reaches, e.g. every child weight at 0, stays in the rest pose
+	for (int j = 0; j < count; j++)
+	{
+		float total = 0;
+		for (int l = 0; l < leaf_clip.size(); l++)
+			if (leaf_scalar[l] > 0)
+				total += leaf_w[l * joints + j];
+		if (total > 0) continue;
+		qacc.set(j, quat(1, 0, 0, 0));
+		tacc.set(j, skel.rest_trans[j]);
+	}
+	batch_normalize(qacc, count);
+	apply_layers(skel, count);
+
+	if (count < joints)
+	{
+		// the joints past count keep their pose, so copy instead of handing the buffers over
+		for (int j = 0; j < count; j++)
+		{
+			quat q = qacc.get(j);
+			vec3 t = tacc.get(j);
+			if (q != pose.local_rot.get(j) || t != pose.local_trans.get(j))
+			{
+				pose.local_rot.set(j, q);
+				pose.local_trans.set(j, t);
+				pose.mark_dirty(j);
+			}
+		}
+		return;
+	}
+
+	// hand the accumulators over to the pose, its old buffers become the next accumulators
+	pose.local_rot.x.swap(qacc.x); pose.local_rot.y.swap(qacc.y);
+	pose.local_rot.z.swap(qacc.z); pose.local_rot.w.swap(qacc.w);
+	pose.local_trans.x.swap(tacc.x); pose.local_trans.y.swap(tacc.y); pose.local_trans.z.swap(tacc.z);
+
+	// the accumulators hold the previous pose now, only joints that moved need the hierarchy pass
+	for (int j = 0; j < joints; j++)
+		if (pose.local_rot.x[j] != qacc.x[j] || pose.local_rot.y[j] != qacc.y[j] || pose.local_rot.z[j] != qacc.z[j] || pose.local_rot.w[j] != qacc.w[j] ||
+			pose.local_trans.x[j] != tacc.x[j] || pose.local_trans.y[j] != tacc.y[j] || pose.local_trans.z[j] != tacc.z[j])
+			pose.mark_dirty(j);
+}
+
+// the sample tick, or the bits of the exact time without a quantum
+static void push_tick(vector<int> &key, double time, double quantum_ms)
+{
+	int64_t t;
+	if (quantum_ms > 0)
+		t = (int64_t)floor(time / quantum_ms + 0.5);
+	else
+		memcpy(&t, &time, sizeof(t));
+	key.push_back((int)t);
+	key.push_back((int)(t >> 32));
+}
+
+uint64_t blend_tree::pose_key(float weight_step, vector<int> &key, int count)
+{
+	key.clear();
+	if (root < 0 || joints == 0) return 0;
+	if (count <= 0 || count > joints)
+		count = joints;
+	update();
+
+	bool masked = false;
+	for (int n = 0; n < nodes.size(); n++)
+		for (int i = 0; i < nodes[n].masks.size(); i++)
+			masked = masked || nodes[n].masks[i] >= 0;
+	if (masked)
+	{
+		fill(leaf_w.begin(), leaf_w.end(), 0.f);
+		fill(node_w.begin() + root * joints, node_w.begin() + (root + 1) * joints, 1.f);
+		propagate(root);
+	}
+
+	key.push_back(mode);
+	key.push_back(count);
+	for (int l = 0; l < leaf_clip.size(); l++)
+	{
+		if (leaf_scalar[l] <= 0) continue;
+		key.push_back(leaf_clip[l]);
+		push_tick(key, leaf_time(l), quantum_ms);
+		key.push_back((int)floor(leaf_scalar[l] / weight_step + 0.5f));
+		// masks make the weight differ per joint
+		if (masked)
+			for (int j = 0; j < count; j++)
+				key.push_back((int)floor(leaf_w[l * joints + j] / weight_step + 0.5f));
+	}
+
+	// the layers after a marker, a clip is never -1
+	key.push_back(-1);
+	for (int l = 0; l < layers.size(); l++)
+	{
+		if (layers[l].weight <= 0) continue;
+		key.push_back(layers[l].clip);
+		push_tick(key, snap(layers[l].time_ms), quantum_ms);
+		key.push_back((int)floor(layers[l].weight / weight_step + 0.5f));
+		// the reference pose is sampled at the exact time
+		push_tick(key, layers[l].ref_ms, 0);
+		// the weights of the mask, its index means nothing in another tree
+		const vector<float> *mask = layers[l].mask >= 0 && layers[l].mask < masks.size() ? &masks[layers[l].mask] : NULL;
+		key.push_back(mask != NULL);
+		if (mask)
+			for (int j = 0; j < count; j++)
+				key.push_back((int)floor((*mask)[j] / weight_step + 0.5f));
+	}
+
+	// fnv-1a over the key
+	uint64_t h = 14695981039346656037ULL;
+	for (int i = 0; i < key.size(); i++)
+	{
+		h ^= (uint32_t)key[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#ifndef LAB474_BLEND_TREE_H_INCLUDED
+#define LAB474_BLEND_TREE_H_INCLUDED
+
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+#include "skeleton.h"
+
+enum blend_node_type
+{
+	BLEND_CLIP,			// leaf, samples one clip of the skeleton
+	BLEND_WEIGHTED,		// fixed weights per child
+	BLEND_1D,			// children sit on thresholds of one parameter, the two around it are mixed
+	BLEND_2D			// children sit at points of two parameters, inverse distance weights
+};
+
+struct blend_node
+{
+	blend_node_type type;
+	int clip = -1;					// BLEND_CLIP
+	int param_x = -1, param_y = -1;	// BLEND_1D and BLEND_2D
+	vector<int> children;
+	vector<float> weights;			// weight of each child, recomputed from the parameters for the blend spaces
+	vector<vec2> positions;			// BLEND_1D (x, ascending) and BLEND_2D: place of each child in the blend space
+	vector<int> masks;				// mask of each child, index into blend_tree::masks or -1 for all joints
+};
+
+// Additive layer on top of the blended pose: the difference of its clip to the pose of
+// the clip at ref_ms is added, times weight and the per joint weight of the mask. Layers
+// play on their own clock and loop, so a short clip (breathing, a flutter) can run over
+// any base. They are applied in order.
+struct blend_layer
+{
+	int clip = -1;
+	float weight = 1;
+	int mask = -1;					// index into blend_tree::masks, -1 for all joints
+	double ref_ms = 0;				// time of the reference pose in the clip
+	double time_ms = 0;				// playback time of the layer
+	float speed = 1;				// of the layer relative to the tree
+};
+
+// Tree of weighted N-way blends over the clips of one skeleton. Every frame the weights are
+// pushed down to one weight per clip and joint, then each clip with a weight is sampled once
+// and accumulated into the pose, then every layer goes over it in one more pass over the
+// joints. All buffers are allocated by bind(), not per frame.
+// Nodes must form a tree: a node may only be the child of one parent. A tree holds the
+// playback state of one instance, copy a bound tree to animate more instances.
+class blend_tree
+{
+public:
+	vector<blend_node> nodes;
+	vector<float> params;
+	vector<vector<float> > masks;		// weight of every joint, 0..1
+	vector<blend_layer> layers;			// additive layers over the tree, see add_layer
+	int root = -1;
+
+	bool sync = true;					// all clips play at the same relative position
+	interp_mode mode = INTERP_SLERP;	// sampling between keys
+	double time_ms = 0;					// playback time if not synced
+	double phase = 0;					// relative position 0..1 if synced
+	double quantum_ms = 0;				// clips are sampled at multiples of it, 0 for the exact time
+	vec3 root_delta = vec3(0);			// root motion of the last advance(), weighted like the clips
+
+	int add_param(float value = 0);
+	int add_clip(int clip);
+	int add_blend(const vector<int> &children, const vector<float> &weights);
+	int add_blend1d(int param, const vector<int> &children, const vector<float> &thresholds);
+	int add_blend2d(int paramx, int paramy, const vector<int> &children, const vector<vec2> &positions);
+	// per joint weights for a child: joints with 0 take the pose of the other children
+	int add_mask(const vector<float> &joint_weights);
+	void set_mask(int node, int child, int mask);
+	// additive layer of clip over the whole tree, returns its index into layers
+	int add_layer(int clip, float weight = 1, int mask = -1, double ref_ms = 0);
+
+	// allocates the buffers for the skeleton and samples the reference poses of the layers,
+	// call again after the tree or the layer clips change
+	void bind(const skeleton &skel);
+	// moves the playback on by dt_ms, synced trees advance by the weighted clip length.
+	// Clips with extracted root motion add the way they covered to root_delta.
+	void advance(double dt_ms);
+	// writes the blended pose into pose.local_rot and pose.local_trans and marks the joints that
+	// changed dirty. Does nothing if playback time and weights are the same as last time.
+	// count > 0 only samples the first count joints, parents come first so 1 is the root alone.
+	void evaluate(const skeleton &skel, skeleton_pose &pose, int count = -1);
+	// forces the next evaluate() to sample again, after editing nodes or masks without bind()
+	void invalidate() { cached = false; }
+	// describes the pose the next evaluate(skel, pose, count) gives: every playing clip and layer with its
+	// sample tick and its weight in steps of weight_step, layers also with the weights of their
+	// mask and their reference time. Trees with the same key give the same
+	// pose up to the step. Returns a hash of the key.
+	uint64_t pose_key(float weight_step, vector<int> &key, int count = -1);
+
+private:
+	void update_weights(blend_node &node);
+	void propagate_scalar(int node, float w);
+	void propagate(int node);
+	void update();
+	double snap(double t) const { return quantum_ms > 0 ? floor(t / quantum_ms) * quantum_ms : t; }
+	double leaf_time(int leaf) const;
+	// the clip at time t into q0 and t0, the first count joints
+	void sample_clip(const skeleton &skel, int clip, double t, int *cursor, int count);
+	void apply_layers(const skeleton &skel, int count);
+
+	int joints = 0;
+	vector<int> leaf_of_node;			// leaf index of every BLEND_CLIP node, -1 otherwise
+	vector<int> leaf_clip;
+	vector<double> leaf_length;
+	vector<const animation_per_bone*> leaf_motion;	// skeleton::root_motion of the clip
+	vector<float> leaf_scalar;			// weight of every leaf without the masks
+	vector<float> leaf_w;				// weight of every leaf and joint, [leaf * joints + joint]
+	vector<float> node_w;				// weight of every node and joint, [node * joints + joint]
+	vector<int> cursors;				// sampler cursor of every leaf and joint
+	vector<int> layer_cursors;			// [layer * joints + joint]
+	vector<quat_stream> layer_ref_rot;	// reference pose of every layer
+	vector<vec3_stream> layer_ref_trans;
+
+	// what the last evaluate() sampled
+	bool cached = false;
+	const skeleton_pose *cached_pose = NULL;
+	double cached_time = 0;
+	vector<float> cached_w;
+	vector<double> cached_layers;		// sample time and weight of every layer
+	int cached_count = 0;
+	interp_mode cached_mode = INTERP_SLERP;
+
+	quat_stream q0, q1, qacc;
+	vec3_stream t0, t1, tacc;
+	vector<float> f;
+	vector<float> layer_w;				// weight of the layer being applied per joint
+};
+
+#endif // LAB474_BLEND_TREE_H_INCLUDED
@@ -1,4 +1,7 @@
 #pragma once
+#include <string>
+#include <vector>
+#include <stdint.h>
 // value_ptr for glm
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -12,6 +15,82 @@ public:
     vec3 translation;
     long long timestamp_ms;
 };
+//authored key of one scalar curve, see anim_sampler.h for the evaluation
+enum curve_interp
+{
+    CURVE_CONSTANT,     //holds value until the next key
+    CURVE_LINEAR,
+    CURVE_CUBIC         //hermite with slope_out of this key and slope_in of the next
+};
+class curve_key
+{
+public:
+    float time_ms;
+    float value;
+    float slope_in;     //value per ms left of the key
+    float slope_out;    //value per ms right of the key
+    int interp;         //curve_interp of the segment starting at this key
+};
+//curves of a sparse channel, euler angles in degrees like LclRotation
+enum curve_channel
+{
+    CURVE_TX, CURVE_TY, CURVE_TZ,
+    CURVE_RX, CURVE_RY, CURVE_RZ,
+    CURVE_COUNT
+};
+//keys of a channel, either owned (read from fbx) or pointing into a mapped anim_file
+template <class K> class key_array
+{
+public:
+    void push_back(const K &key) { owned.push_back(key); }
+    void reserve(int n) { owned.reserve(n); }
+    //n owned keys, filled through writable()
+    void resize(int n) { mapped = NULL; owned.resize(n); }
+    K *writable() { return owned.data(); }
+    //uses count keys at keys without copying, they must outlive the array
+    void map(const K *keys, int count) { owned.clear(); mapped = keys; mapped_count = count; }
+
+    int size() const { return mapped ? mapped_count : (int)owned.size(); }
+    bool empty() const { return size() == 0; }
+    const K *data() const { return mapped ? mapped : owned.data(); }
+    const K &operator[](int i) const { return data()[i]; }
+    const K &front() const { return data()[0]; }
+    const K &back() const { return data()[size() - 1]; }
+    const K *begin() const { return data(); }
+    const K *end() const { return data() + size(); }
+
+private:
+    vector<K> owned;
+    const K *mapped = NULL;
+    int mapped_count = 0;
+};
+typedef key_array<keyframe> keyframe_array;
+typedef key_array<curve_key> curve_key_array;
+//quantized key, 12 bytes instead of the 40 of keyframe (see anim_compress.h)
+class packed_key
+{
+public:
+    uint16_t rot[3];    //smallest three quaternion: 2 bit index of the dropped component, 3 x 15 bit
+    uint16_t trans[3];  //translation scaled into the range of the track
+};
+//quantized channel with implicit key times: key i is at start_ms + i * step_ms
+class packed_track
+{
+public:
+    float start_ms = 0;
+    float step_ms = 0;
+    vec3 trans_min = vec3(0);
+    vec3 trans_extent = vec3(0);   //trans_max - trans_min
+    key_array<packed_key> keys;
+};
+//root motion key of an in place channel: the translation taken out of the channel (see anim_motion.h)
+class motion_key
+{
+public:
+    float time_ms;      //from the first key of the channel
+    vec3 offset;        //from the translation at the first key
+};
+typedef key_array<motion_key> motion_key_array;
 class animation_per_bone
 {
 public:
@@ -19,7 +98,10 @@ public:
     long long duration;
     int frames;
     string bone;
-    vector<keyframe> keyframes;
+    keyframe_array keyframes;          //sampled keys, empty for a sparse channel
+    vector<curve_key_array> curves;    //sparse channel: CURVE_COUNT authored curves, empty otherwise
+    packed_track packed;               //quantized channel: keys in packed, keyframes empty
+    motion_key_array root_motion;      //in place channel: the extracted root motion, empty otherwise
 };
 class all_animations
 {
@@ -31,6 +113,8 @@ public:
 
 //**************************************************
 
+class clip_library;
+
 class bone
 {
 public:
@@ -38,87 +122,9 @@ public:
     string name;
     vec3 pos;
     quat q;
-	float len_bone=0;
-	mat4 currentT=mat4(1);
-	mat4 currentBone_wo_S = mat4(1);
     bone *parent = NULL;
     vector<bone*> kids;
     unsigned int index;            //a unique number for each bone, at the same time index of the animatiom matrix array
-    mat4 *mat = NULL;            //address of one lement from the animation matrix array
-	mat4 *matbone = NULL;            //address of one lement from the animation matrix array
-    // searches for the animation and sets the animation matrix element to the recent matrix gained from the keyframe
-    void play_animation(float keyframenumber, string animationname, float inter)
-    {
-      float t = keyframenumber - int(keyframenumber);
-      if (animation[1]->keyframes.size() > keyframenumber)
-      {
-          float ratio = 1. * animation[1]->keyframes.size() / animation[3]->keyframes.size();
-          int framea = (int)keyframenumber;
-          int frameb = (int)keyframenumber + 1;
-          //quat q = animation[i]->keyframes[keyframenumber].quaternion;
-          quat qa = animation[1]->keyframes[framea].quaternion;
-          quat qb = animation[1]->keyframes[frameb].quaternion;
-          quat qr1 = slerp(qa,qb,t);
-          quat qc = animation[3]->keyframes[framea/ratio].quaternion;
-          quat qd = animation[3]->keyframes[frameb/ratio].quaternion;
-          quat qr2 = slerp(qc,qd,t);
-          quat qrf = slerp(qr1,qr2,inter);
-          //vec3 tr = animation[i]->keyframes[keyframenumber].translation;
-          vec3 ta = animation[1]->keyframes[framea].translation;
-          vec3 tb = animation[1]->keyframes[frameb].translation;
-          vec3 tr1 = mix(ta,tb,t);
-          vec3 tc = animation[3]->keyframes[framea/ratio].translation;
-          vec3 td = animation[3]->keyframes[frameb/ratio].translation;
-          vec3 tr2 = mix(tc,td,t);
-          vec3 trf = mix(tr1,tr2,inter);
-
-
-          mat4 R = mat4(qrf);
-          mat4 T = translate(mat4(1), trf);
-  				len_bone = length(trf);
-  				currentT = T;
-  				mat4 M = T * R;
-  				mat4 iT = inverse(T);
-
-          if (mat)
-          {
-              mat4 parentmat = mat4(1);
-              if (parent)
-                  parentmat = *parent->mat;
-              *mat = parentmat * M;
-          }
-          else
-          {
-            *mat = mat4(1);
-          }
-					if (matbone)
-					{
-					   mat4 parentmat = mat4(1);
-					   float len = len_bone;
-					   if (parent)
-						 {
-						    parentmat = parent->currentT*parent->currentBone_wo_S;
-						 //len = parent->len_bone;
-						 }
-						 currentBone_wo_S = parentmat * R;
-						 *matbone = currentBone_wo_S;// *scale(mat4(1), vec3(len, len, len));
-
-						 *matbone = (*mat)*scale(mat4(1), vec3(len, len, len));
-
-             if (name.find("ctrl") != std::string::npos || name.find("pt") != std::string::npos
-             || name.find("control") != std::string::npos || name.find("Control") != std::string::npos
-             || name.find("dragon2") != std::string::npos || name.find("Bone_002") != std::string::npos
-             || name.find("Armature") != std::string::npos)
-             {
-                *matbone = mat4(0);
-             }
-				   }
-        for (int i = 0; i < kids.size(); i++)
-            kids[i]->play_animation(keyframenumber,animationname, inter);
-      }
-    }
-
-
 
     //writes into the segment positions and into the animation index VBO
     void write_to_VBOs(vec3 origin, vector<vec3> &vpos, vector<unsigned int> &imat)
@@ -136,38 +142,10 @@ public:
         for (int i = 0; i < kids.size(); i++)
             kids[i]->write_to_VBOs(endp, vpos, imat);
     }
-    //searches for the correct animations as well as sets the correct element from the animation matrix array
-    void set_animations(all_animations *all_anim,mat4 *matrices, mat4 *matbones,int &animsize)
-    {
-        for (int ii = 0; ii < all_anim->animations.size(); ii++)
-            if (all_anim->animations[ii].bone == name)
-                animation.push_back(&all_anim->animations[ii]);
-
-        mat = &matrices[index];
-		matbone = &matbones[index];
-        animsize++;
-
-        for (int i = 0; i < kids.size(); i++)
-            kids[i]->set_animations(all_anim, matrices, matbones, animsize);
-    }
-
-    int getKeyFrameCount(std::string animationName) {
-      for (auto anim : animation) {
-          if (anim->name == animationName) {
-              return anim->frames;
-            }
-          }
-          return 1;
-        }
-
-        long long getDuration(std::string animationName) {
-          for (auto anim : animation) {
-            if (anim->name == animationName) {
-              return anim->duration;
-            }
-          }
-          return 0;
-        }
+    //binds the channels of every clip of the library to the bone and its kids,
+    //animation[clip] is NULL where the bone has no channel (see clip_library.cpp)
+    void set_animations(const clip_library &clips, int &animsize);
 };
 
-int readtobone(string file,all_animations *all_animation, bone **proot);
+//sparse keeps the authored curves of every channel instead of sampling them at 24 fps
+int readtobone(string file,all_animations *all_animation, bone **proot, bool sparse = false);
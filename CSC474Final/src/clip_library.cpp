@@ -0,0 +1,77 @@
+#include "clip_library.h"
+
+using namespace std;
+
+void clip_library::build(all_animations *all_anim)
+{
+	clip_names.clear();
+	bone_names.clear();
+	clip_frames.clear();
+	clip_duration.clear();
+	clip_ids.clear();
+	bone_ids.clear();
+
+	// first pass: intern the names, remember the clip and bone of every channel
+	vector<int> channel_clip, channel_bone;
+	unordered_map<string, int> taken;		// "clip/bone" -> how often read so far
+	for (int ii = 0; ii < all_anim->animations.size(); ii++)
+	{
+		animation_per_bone &anim = all_anim->animations[ii];
+
+		unordered_map<string, int>::iterator b = bone_ids.find(anim.bone);
+		int bone = b != bone_ids.end() ? b->second : -1;
+		if (bone < 0)
+		{
+			bone = bone_names.size();
+			bone_ids[anim.bone] = bone;
+			bone_names.push_back(anim.bone);
+		}
+
+		int repeat = taken[anim.name + "/" + anim.bone]++;
+		string name = repeat == 0 ? anim.name : anim.name + "#" + to_string(repeat + 1);
+		unordered_map<string, int>::iterator c = clip_ids.find(name);
+		int clip = c != clip_ids.end() ? c->second : -1;
+		if (clip < 0)
+		{
+			clip = clip_names.size();
+			clip_ids[name] = clip;
+			clip_names.push_back(name);
+			clip_frames.push_back(anim.frames);
+			clip_duration.push_back(anim.duration);
+		}
+		channel_clip.push_back(clip);
+		channel_bone.push_back(bone);
+	}
+
+	channels.assign(clip_count() * bone_count(), (animation_per_bone*)NULL);
+	for (int ii = 0; ii < all_anim->animations.size(); ii++)
+		channels[channel_clip[ii] * bone_count() + channel_bone[ii]] = &all_anim->animations[ii];
+}
+
+int clip_library::clip_id(const string &name) const
+{
+	unordered_map<string, int>::const_iterator it = clip_ids.find(name);
+	return it == clip_ids.end() ? -1 : it->second;
+}
+
+int clip_library::bone_id(const string &name) const
+{
+	unordered_map<string, int>::const_iterator it = bone_ids.find(name);
+	return it == bone_ids.end() ? -1 : it->second;
+}
+
+//**************************************************
+
+void bone::set_animations(const clip_library &clips, int &animsize)
+{
+	animation.clear();
+	int id = clips.bone_id(name);
+	if (id >= 0)
+		for (int c = 0; c < clips.clip_count(); c++)
+			animation.push_back(clips.channel(c, id));
+
+	animsize++;
+
+	for (int i = 0; i < kids.size(); i++)
+		kids[i]->set_animations(clips, animsize);
+}
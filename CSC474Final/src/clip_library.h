@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef LAB474_CLIP_LIBRARY_H_INCLUDED
+#define LAB474_CLIP_LIBRARY_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "bone.h"
+
+// Interned clip and bone names of all_animations. Every name gets a dense id once at
+// load, after that a channel is found by plain indexing with [clip * bone_count + bone].
+// Clips are numbered in the order they were read; a name read again for a bone that
+// already has it (the same take name in a second file) becomes a new clip "name#2".
+class clip_library
+{
+public:
+	vector<string> clip_names;
+	vector<string> bone_names;
+	vector<int> clip_frames;				// animation_per_bone::frames of every clip
+	vector<long long> clip_duration;		// animation_per_bone::duration of every clip
+
+	void build(all_animations *all_anim);
+
+	// -1 if the name is unknown
+	int clip_id(const string &name) const;
+	int bone_id(const string &name) const;
+
+	int clip_count() const { return (int)clip_names.size(); }
+	int bone_count() const { return (int)bone_names.size(); }
+	// NULL if the bone has no channel in the clip
+	animation_per_bone *channel(int clip, int bone) const { return channels[clip * bone_count() + bone]; }
+
+private:
+	unordered_map<string, int> clip_ids, bone_ids;
+	vector<animation_per_bone*> channels;
+};
+
+#endif // LAB474_CLIP_LIBRARY_H_INCLUDED
@@ -10,6 +10,7 @@ using namespace std;
 
 #include <fstream>
 #include "bone.h"
+#include "thread_pool.h"
 using namespace glm;
 
 /* Tab character ("\t") counter */
@@ -160,59 +161,39 @@ void DisplayAnimation(FbxAnimLayer* pAnimLayer, FbxNode* pNode, bool isSwitcher
 void DisplayChannels(FbxNode* pNode, FbxAnimLayer* pAnimLayer, void(*DisplayCurve) (FbxAnimCurve* pCurve), void(*DisplayListCurve) (FbxAnimCurve* pCurve, FbxProperty* pProperty), bool isSwitcher);
 void DisplayCurveKeys(FbxAnimCurve* pCurve);
 void DisplayListCurveKeys(FbxAnimCurve* pCurve, FbxProperty* pProperty);
-void PrintAnimationData(all_animations *all_animation, FbxScene* lScene);
-void CalcTransRotAnim(all_animations *all_animation, FbxScene* lScene, FbxNode* lNode, int animno)
+void PrintAnimationData(all_animations *all_animation, FbxScene* lScene, bool sparse);
+//the bones of the scene in the order the channels are stored: depth first, a node before its children
+void CollectAnimNodes(FbxNode* lNode, vector<FbxNode*> &nodes)
 {
-    FbxAnimStack* currAnimStack = lScene->GetSrcObject<FbxAnimStack>(animno);
-    FbxString animStackName = currAnimStack->GetName();
-    FbxString mAnimationName = animStackName.Buffer();
-    FbxTakeInfo* takeInfo = lScene->GetTakeInfo(animStackName);
-    FbxTime start = takeInfo->mLocalTimeSpan.GetStart();
-    FbxTime end = takeInfo->mLocalTimeSpan.GetStop();
-    long long duration = end.GetMilliSeconds();
-    int keyframecount = end.GetFrameCount(FbxTime::eFrames24) - start.GetFrameCount(FbxTime::eFrames24) + 1;
-
-    const char* nodeName = lNode->GetName();
-    //    cout << endl << "\t" << "bone name: " << nodeName << endl << endl;
-
-    animation_per_bone anim;
-    anim.bone = nodeName;
-    anim.duration = duration;
-    anim.frames = keyframecount;
-    anim.name = mAnimationName;
-
-
-    for (FbxLongLong i = start.GetFrameCount(FbxTime::eFrames24); i <= end.GetFrameCount(FbxTime::eFrames24); ++i)
+    nodes.push_back(lNode);
+    for (int k = 0; k < lNode->GetChildCount(); k++)
+        CollectAnimNodes(lNode->GetChild(k), nodes);
+}
+
+//samples the frames first..last of one bone into the preallocated keys of anim.
+//A job only reads the curves of its own node through its own evaluator, so the
+//jobs of one clip can run on different threads.
+void CalcTransRotAnim(animation_per_bone &anim, FbxAnimEvaluator* lEvaluator, FbxNode* lNode, FbxLongLong first, FbxLongLong last)
+{
+    keyframe *keys = anim.keyframes.writable();
+    for (FbxLongLong i = first; i <= last; ++i)
     {
         FbxTime currTime;
         currTime.SetFrame(i, FbxTime::eFrames24);
         long long time_ms=currTime.GetMilliSeconds();
-        //cout << "\t" << "\t" << "frame time stamp (ms): " << time_ms << endl;
-        FbxDouble3 translation = lNode->EvaluateLocalTranslation(currTime);
+        FbxDouble3 translation = lEvaluator->GetNodeLocalTranslation(lNode, currTime);
         float t1, t2, t3;
         t1 = translation[0];
         t2 = translation[1];
         t3 = translation[2];
-        //    cout << "\t" << "\t" << "translation (x,y,z): " << t1 << ", " << t2 << ", " << t3 << endl;
 
-        FbxDouble3 rotation = lNode->EvaluateLocalRotation(currTime);
-        FbxAMatrix& loctraf = lNode->EvaluateLocalTransform(currTime);
+        FbxDouble3 rotation = lEvaluator->GetNodeLocalRotation(lNode, currTime);
 
         float e1, e2, e3;
         e1 = rotation[0];
         e2 = rotation[1];
         e3 = rotation[2];
 
-        float u0, u1, u2, u3;
-
-        u0 = sqrt(cos(e2*PIe / 180)*cos(e1*PIe / 180) + cos(e2*PIe / 180)*cos(e3*PIe / 180) - sin(e2*PIe / 180)*sin(e1*PIe / 180)*sin(e3*PIe / 180) + cos(e1*PIe / 180)* cos(e3*PIe / 180) + 1) / 2;
-        u1 = (cos(e1*PIe / 180)*sin(e3*PIe / 180) + cos(e2*PIe / 180)*sin(e3*PIe / 180) + sin(e2*PIe / 180)*sin(e1*PIe / 180)*cos(e3*PIe / 180)) / sqrt(cos(e2*PIe / 180)* cos(e1*PIe / 180) + cos(e2*PIe / 180)*cos(e3*PIe / 180) - sin(e2*PIe / 180)*sin(e1*PIe / 180)*sin(e3*PIe / 180) + cos(e1*PIe / 180)*cos(e3*PIe / 180) + 1) / 2;
-        u2 = (sin(e2*PIe / 180)*sin(e3*PIe / 180) - cos(e2*PIe / 180)*sin(e1*PIe / 180)*cos(e3*PIe / 180) - sin(e1*PIe / 180)) / sqrt(cos(e2*PIe / 180)*cos(e1*PIe / 180) + cos(e2*PIe / 180)*cos(e3*PIe / 180) - sin(e2*PIe / 180)*sin(e1*PIe / 180)*sin(e3*PIe / 180) + cos(e1*PIe / 180)*cos(e3*PIe / 180) + 1) / 2;
-        u3 = (sin(e2*PIe / 180)*cos(e1*PIe / 180) + sin(e2*PIe / 180)*cos(e3*PIe / 180) + cos(e2*PIe / 180)*sin(e1*PIe / 180)*sin(e3*PIe / 180)) / sqrt(cos(e2*PIe / 180)* cos(e1*PIe / 180) + cos(e2*PIe / 180)*cos(e3*PIe / 180) - sin(e2*PIe / 180)*sin(e1*PIe / 180)*sin(e3*PIe / 180) + cos(e1*PIe / 180)*cos(e3*PIe / 180) + 1) / 2;
-
-        u3 = -u3;
-        u0 = -u0;
-
         e1 = e1*PIe / 180;
         e2 = e2*PIe / 180;
         e3 = e3*PIe / 180;
@@ -222,7 +203,7 @@ void CalcTransRotAnim(all_animations *all_animation, FbxScene* lScene, FbxNode*
         q1 = -(sin(e1 / 2)*cos(e2 / 2)*cos(e3 / 2) - cos(e1 / 2)*sin(e2 / 2)*sin(e3 / 2));
         q2 =-( cos(e1 / 2)*sin(e2 / 2)*cos(e3 / 2) + sin(e1 / 2)*cos(e2 / 2)*sin(e3 / 2));
         q3 =-( cos(e1 / 2)*cos(e2 / 2)*sin(e3 / 2) - sin(e1 / 2)*sin(e2 / 2)*cos(e3 / 2));
-        keyframe key;
+        keyframe &key = keys[i - first];
         key.timestamp_ms = time_ms;
         key.quaternion.w = q0;
         key.quaternion.x = q1;
@@ -232,26 +213,65 @@ void CalcTransRotAnim(all_animations *all_animation, FbxScene* lScene, FbxNode*
         key.translation.x = t1;
         key.translation.y = t2;
         key.translation.z = t3;
+    }
+}
+
 
-        anim.keyframes.push_back(key);
 
-        //    cout << "\t" << "\t" << "quaternion (i,j,k,re): " << q1 << ", " << q2 << ", " << q3 << ", " << q0 << endl;
+static int InterpolationFlagToIndex(int flags);
 
+//copies the authored keys of one curve, a property without a curve becomes one constant key
+void CopyCurveKeys(curve_key_array &keys, FbxAnimCurve* lCurve, double lDefault)
+{
+    int count = lCurve ? lCurve->KeyGetCount() : 0;
+    if (count == 0)
+    {
+        keys.resize(1);
+        curve_key &key = keys.writable()[0];
+        key.time_ms = 0;
+        key.value = lDefault;
+        key.slope_in = key.slope_out = 0;
+        key.interp = CURVE_CONSTANT;
+        return;
     }
-    all_animation->animations.push_back(anim);
 
-    for (int k = 0; k < lNode->GetChildCount();k++)
-        CalcTransRotAnim(all_animation,lScene, lNode->GetChild(k), animno);
+    keys.resize(count);
+    for (int k = 0; k < count; k++)
+    {
+        curve_key &key = keys.writable()[k];
+        key.time_ms = lCurve->KeyGetTime(k).GetMilliSeconds();
+        key.value = lCurve->KeyGetValue(k);
+        //fbx derivatives are per second, weighted tangents are taken as plain hermite slopes
+        key.slope_in = lCurve->KeyGetLeftDerivative(k) / 1000.0f;
+        key.slope_out = lCurve->KeyGetRightDerivative(k) / 1000.0f;
+        switch (InterpolationFlagToIndex(lCurve->KeyGetInterpolation(k)))
+        {
+            case 1: key.interp = CURVE_CONSTANT; break;
+            case 3: key.interp = CURVE_CUBIC; break;
+            default: key.interp = CURVE_LINEAR; break;
+        }
+    }
+}
 
+//sparse import of one bone: the curves of the local translation and euler rotation
+void CalcSparseCurves(animation_per_bone &anim, FbxAnimLayer* lAnimLayer, FbxNode* lNode)
+{
+    FbxDouble3 translation = lNode->LclTranslation.Get();
+    FbxDouble3 rotation = lNode->LclRotation.Get();
+    anim.curves.resize(CURVE_COUNT);
+    CopyCurveKeys(anim.curves[CURVE_TX], lNode->LclTranslation.GetCurve(lAnimLayer, FBXSDK_CURVENODE_COMPONENT_X), translation[0]);
+    CopyCurveKeys(anim.curves[CURVE_TY], lNode->LclTranslation.GetCurve(lAnimLayer, FBXSDK_CURVENODE_COMPONENT_Y), translation[1]);
+    CopyCurveKeys(anim.curves[CURVE_TZ], lNode->LclTranslation.GetCurve(lAnimLayer, FBXSDK_CURVENODE_COMPONENT_Z), translation[2]);
+    CopyCurveKeys(anim.curves[CURVE_RX], lNode->LclRotation.GetCurve(lAnimLayer, FBXSDK_CURVENODE_COMPONENT_X), rotation[0]);
+    CopyCurveKeys(anim.curves[CURVE_RY], lNode->LclRotation.GetCurve(lAnimLayer, FBXSDK_CURVENODE_COMPONENT_Y), rotation[1]);
+    CopyCurveKeys(anim.curves[CURVE_RZ], lNode->LclRotation.GetCurve(lAnimLayer, FBXSDK_CURVENODE_COMPONENT_Z), rotation[2]);
 }
 
 
 
 //***************************************************************************************************************************************************************
-void PrintAnimationData(all_animations *all_animation,FbxScene* lScene)
+void PrintAnimationData(all_animations *all_animation,FbxScene* lScene, bool sparse)
 {
-    int i;
-
     int count_animations = lScene->GetSrcObjectCount<FbxAnimStack>();
 
     ////falls es keine animation gibt
@@ -262,6 +282,16 @@ void PrintAnimationData(all_animations *all_animation,FbxScene* lScene)
     }
 
     FbxNode* lNode = lScene->GetRootNode();
+    vector<FbxNode*> nodes;
+    for (int k = 0; k < lNode->GetChildCount(); k++)
+        CollectAnimNodes(lNode->GetChild(k), nodes);
+
+    //one evaluator per worker, they cache the state of the nodes they evaluated
+    thread_pool pool;
+    vector<FbxAnimEvaluator*> evaluators;
+    for (int w = 0; w < pool.size(); w++)
+        evaluators.push_back(FbxAnimEvalClassic::Create(lScene, ""));
+
     for (int l = 0; l < count_animations; l++)
     {
         FbxAnimStack* currAnimStack = lScene->GetSrcObject<FbxAnimStack>(l);
@@ -271,15 +301,40 @@ void PrintAnimationData(all_animations *all_animation,FbxScene* lScene)
         FbxTime start = takeInfo->mLocalTimeSpan.GetStart();
         FbxTime end = takeInfo->mLocalTimeSpan.GetStop();
         long long duration = end.GetMilliSeconds();
-        int keyframecount = end.GetFrameCount(FbxTime::eFrames24) - start.GetFrameCount(FbxTime::eFrames24) + 1;
+        FbxLongLong first = start.GetFrameCount(FbxTime::eFrames24);
+        FbxLongLong last = end.GetFrameCount(FbxTime::eFrames24);
+        int keyframecount = last - first + 1;
 
         cout << endl;
         cout << "animation name: " << mAnimationName << endl;
         cout << "key frame count: " << keyframecount << endl;
         cout << "animation duration (ms): " << duration << endl;
-        for (int k = 0; k < lNode->GetChildCount(); k++)
-            CalcTransRotAnim(all_animation,lScene, lNode->GetChild(k), l);
+
+        //all channels of the clip are allocated up front, every (clip, bone) job fills its own
+        int base = all_animation->animations.size();
+        all_animation->animations.resize(base + nodes.size());
+        for (int j = 0; j < nodes.size(); j++)
+        {
+            animation_per_bone &anim = all_animation->animations[base + j];
+            anim.bone = nodes[j]->GetName();
+            anim.duration = duration;
+            anim.frames = keyframecount;
+            anim.name = mAnimationName;
+            if (!sparse)
+                anim.keyframes.resize(keyframecount > 0 ? keyframecount : 0);
+        }
+        FbxAnimLayer* lAnimLayer = currAnimStack->GetMember<FbxAnimLayer>(0);
+        pool.parallel_for(nodes.size(), [&](int j, int worker)
+        {
+            if (sparse)
+                CalcSparseCurves(all_animation->animations[base + j], lAnimLayer, nodes[j]);
+            else
+                CalcTransRotAnim(all_animation->animations[base + j], evaluators[worker], nodes[j], first, last);
+        });
     }
+
+    for (int w = 0; w < evaluators.size(); w++)
+        evaluators[w]->Destroy();
 }
 //***************************************************************************************************************************************************************
 void DisplayAnimation(FbxScene* pScene)
@@ -722,7 +777,7 @@ void DisplayListCurveKeys(FbxAnimCurve* pCurve, FbxProperty* pProperty)
  * and prints its contents in an xml format to stdout.
  */
 
-int readtobone(string file, all_animations *all_animation,bone **proot)
+int readtobone(string file, all_animations *all_animation,bone **proot, bool sparse)
 {
 
     //ifstream fileHandle("fgdfg");
@@ -812,7 +867,7 @@ int readtobone(string file, all_animations *all_animation,bone **proot)
 
     //cout << endl;
     //cout << "Animation" << endl;
-    PrintAnimationData(all_animation,lScene);
+    PrintAnimationData(all_animation,lScene,sparse);
 
     /////////////////////
     /////    End
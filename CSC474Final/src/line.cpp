@@ -1,5 +1,6 @@
 #include "line.h"
 #include <iostream>
+#include <algorithm>
 #include "GLSL.h"
 
 
@@ -92,7 +93,8 @@ void Line::reset()
 bool Line::re_init_line(std::vector<vec3> &points)
 {
 	// Initialize the vertex array object
-	glGenVertexArrays(1, &vaoID);
+	if (vaoID == 0)
+		glGenVertexArrays(1, &vaoID);
 	glBindVertexArray(vaoID);
 
 	// Send the position array to the GPU
@@ -101,10 +103,33 @@ bool Line::re_init_line(std::vector<vec3> &points)
 	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
 	glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(vec3), points.data(), GL_STATIC_DRAW);
 	segment_count = points.size();
+	capacity = points.size();
 	//assert(glGetError() == GL_NO_ERROR);
 	return true;
 }
 //*********************************************************************************
+bool Line::update_line(const std::vector<vec3> &points, int first)
+{
+	if (vaoID == 0)
+		glGenVertexArrays(1, &vaoID);
+	if (posBufID == 0)
+		glGenBuffers(1, &posBufID);
+	glBindVertexArray(vaoID);
+	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
+	if (points.size() > capacity)
+	{
+		// grow by doubling, so appending a point does not copy the whole line every time
+		capacity = std::max((int)points.size(), capacity * 2);
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(vec3), NULL, GL_DYNAMIC_DRAW);
+		first = 0;
+	}
+	first = std::min(std::max(first, 0), (int)points.size());
+	if (first < points.size())
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(vec3), (points.size() - first) * sizeof(vec3), points.data() + first);
+	segment_count = points.size();
+	return true;
+}
+//*********************************************************************************
 void Line::draw(mat4 &P, mat4 &V, vec3 &colorvec3)
 {	
 		if (segment_count < 2)
@@ -129,31 +154,35 @@ void Line::draw(mat4 &P, mat4 &V, vec3 &colorvec3)
 }
 
 
+void cardinal_tangents(vector<vec3> &tangents, const vector<vec3> &points, float curly)
+{
+	int n = points.size();
+	tangents.assign(n, vec3(0, 0, 0));
+	if (n < 3) return;
+	vector<vec3> A(n);
+	vector<double> Bi(n);
+
+	Bi[1] = -0.25*(4. / curly);
+	A[1] = (points[2] - points[0] - tangents[0]) / 4.0f;
+	for (int i = 2; i < n - 1; i++)
+	{
+		Bi[i] = -1 / (4 + Bi[i - 1]);
+		A[i] = -(points[i + 1] - points[i - 1] - A[i - 1]) * (float)Bi[i];
+	}
+	for (int i = n - 2; i > 0; i--)
+		tangents[i] = A[i] + tangents[i + 1] * (float)Bi[i];
+}
+
 void cardinal_curve(vector<vec3> &result_path, vector<vec3> &original_path,  int lod, float curly)
 {
 	
 	if (original_path.size()<3) return;
 	result_path.clear();
-	int n1 = original_path.size() + 1;
-	vec3 *P, *d, *A, first, last;
-	vec4 *B;
-
-	double *Bi = NULL;
-	P = new vec3[n1];
-	d = new vec3[n1];
-	A = new vec3[n1];
-	B = new vec4[lod];
-
-	//punkte setzen
-	for (int ii = 0; ii<original_path.size(); ii++)
-		P[ii] = original_path[ii];
+	vector<vec3> d;
+	vec4 *B = new vec4[lod];
+	const vector<vec3> &P = original_path;
+	cardinal_tangents(d, original_path, curly);
 
-
-
-	d[0] = vec3(0, 0, 0);
-	d[original_path.size() - 1] = vec3(0, 0, 0);
-
-	Bi = new double[n1];
 	double t = 0;
 	double tt = 1. / (lod - 1.);
 	for (int i = 0; i< lod; i++)
@@ -163,25 +192,6 @@ void cardinal_curve(vector<vec3> &result_path, vector<vec3> &original_path,  int
 		t += tt;
 	}
 
-	//findpoints
-	Bi[1] = -0.25*(4. / curly);
-
-	A[1].x = (P[2].x - P[0].x - d[0].x) / 4;
-	A[1].y = (P[2].y - P[0].y - d[0].y) / 4;
-	A[1].z = (P[2].z - P[0].z - d[0].z) / 4;
-	for (int i = 2; i < original_path.size() - 1; i++)
-	{
-		Bi[i] = -1 / (4 + Bi[i - 1]);
-		A[i].x = -(P[i + 1].x - P[i - 1].x - A[i - 1].x)*Bi[i];
-		A[i].y = -(P[i + 1].y - P[i - 1].y - A[i - 1].y)*Bi[i];
-		A[i].z = -(P[i + 1].z - P[i - 1].z - A[i - 1].z)*Bi[i];
-	}
-	for (int i = original_path.size() - 2; i > 0; i--)
-	{
-		d[i].x = A[i].x + d[i + 1].x*Bi[i];
-		d[i].y = A[i].y + d[i + 1].y*Bi[i];
-		d[i].z = A[i].z + d[i + 1].z*Bi[i];
-	}
 	//points
 
 	float X, Y, Z;
@@ -222,10 +232,148 @@ void cardinal_curve(vector<vec3> &result_path, vector<vec3> &original_path,  int
 	}
 
 
-	if (P != NULL)	delete[] P;
-	if (d != NULL)	delete[] d;
-	if (A != NULL)	delete[] A;
 	if (B != NULL)	delete[] B;
-	if (Bi)			delete[] Bi;
 
-}
\ No newline at end of file
+}
+
+//*********************************************************************************
+
+// a tangent that moved less than this (relative to its length) counts as unchanged
+#define SPLINE_TOLERANCE 1e-5f
+
+static bool settled(const vec3 &a, const vec3 &b)
+{
+	return length(a - b) <= SPLINE_TOLERANCE * (1 + length(b));
+}
+
+void CardinalSpline::set(const vector<vec3> &points)
+{
+	pts = points;
+	d.assign(pts.size(), vec3(0));
+	A.assign(pts.size(), vec3(0));
+	solve(0, 0, true);
+}
+
+void CardinalSpline::insert(int index, const vec3 &point)
+{
+	index = std::min(std::max(index, 0), (int)pts.size());
+	pts.insert(pts.begin() + index, point);
+	d.insert(d.begin() + index, vec3(0));
+	A.insert(A.begin() + index, vec3(0));
+	solve(index, 1, pts.size() <= 3);
+}
+
+void CardinalSpline::move(int index, const vec3 &point)
+{
+	if (index < 0 || index >= pts.size()) return;
+	pts[index] = point;
+	solve(index, 0, pts.size() < 3);
+}
+
+void CardinalSpline::erase(int index)
+{
+	if (index < 0 || index >= pts.size()) return;
+	pts.erase(pts.begin() + index);
+	d.erase(d.begin() + index);
+	A.erase(A.begin() + index);
+	solve(index, -1, pts.size() < 3);
+}
+
+void CardinalSpline::solve(int index, int shift, bool full)
+{
+	int n = pts.size();
+	first_changed = 0;
+	last_changed = -1;
+	if (n < 3)
+	{
+		fill(d.begin(), d.end(), vec3(0));
+		samples.clear();
+		return;
+	}
+	if (samples.size() != 2 + (n - 1 - shift) * (lod - 1))
+		full = true;
+
+	// Bi only depends on the index, it is computed once
+	if (Bi.empty())
+		Bi.push_back(0);
+	while (Bi.size() < n)
+		Bi.push_back(Bi.size() == 1 ? -0.25*(4. / curly) : -1 / (4 + Bi.back()));
+
+	// the ends have no tangent, an erase may have shifted one in
+	d[0] = vec3(0);
+	d[n - 1] = vec3(0);
+
+	// forward sweep from the first A that sees the edit until A settles again
+	int start = full ? 1 : std::max(1, index - 1);
+	int stop = n - 2;
+	for (int i = start; i <= n - 2; i++)
+	{
+		vec3 a = i == 1 ? (pts[2] - pts[0] - d[0]) / 4.0f : -(pts[i + 1] - pts[i - 1] - A[i - 1]) * (float)Bi[i];
+		bool same = settled(a, A[i]);
+		A[i] = a;
+		if (!full && i > index + 1 && same)
+		{
+			stop = i;
+			break;
+		}
+	}
+
+	// back substitution from there until the tangents settle before the edit
+	int low = 1;
+	for (int i = stop; i > 0; i--)
+	{
+		vec3 t = A[i] + d[i + 1] * (float)Bi[i];
+		bool same = settled(t, d[i]);
+		d[i] = t;
+		low = i;
+		if (!full && i < start && same)
+			break;
+	}
+
+	int first = full ? 0 : std::max(0, std::min(low - 1, index - 1));
+	int last = full || shift != 0 ? n - 2 : std::min(n - 2, std::max(stop, index));
+	if (full)
+		samples.assign(2 + (n - 1) * (lod - 1), vec3(0));
+	else if (shift > 0)
+	{
+		// the segments after the edit keep their samples, one segment further on
+		int at = std::min(curve_index(index), (int)samples.size());
+		samples.insert(samples.begin() + at, lod - 1, vec3(0));
+		last = std::min(n - 2, std::max(stop, index));
+	}
+	else if (shift < 0)
+	{
+		int at = std::min(curve_index(index), (int)samples.size() - (lod - 1));
+		samples.erase(samples.begin() + at, samples.begin() + at + lod - 1);
+		last = std::min(n - 2, std::max(stop, index));
+	}
+	sample(first, last);
+}
+
+void CardinalSpline::sample(int first, int last)
+{
+	if (B.size() != lod)
+	{
+		B.resize(lod);
+		double t = 0;
+		double tt = 1. / (lod - 1.);
+		for (int i = 0; i < lod; i++)
+		{
+			double t1 = 1 - t, t12 = t1*t1, t2 = t*t;
+			B[i] = vec4(t1*t12, 3 * t*t12, 3 * t2*t1, t*t2);
+			t += tt;
+		}
+	}
+
+	for (int i = first; i <= last; i++)
+	{
+		vec3 p0 = pts[i], p1 = pts[i] + d[i], p2 = pts[i + 1] - d[i + 1], p3 = pts[i + 1];
+		vec3 *out = &samples[curve_index(i)];
+		for (int k = 0; k < lod; k++)
+			out[k] = p0 * B[k].x + p1 * B[k].y + p2 * B[k].z + p3 * B[k].w;
+	}
+	// cardinal_curve starts with the first point flattened onto z = 0
+	samples[0] = vec3(pts[0].x, pts[0].y, 0);
+	first_changed = first;
+	last_changed = last;
+}
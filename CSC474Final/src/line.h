@@ -24,17 +24,62 @@ public:
 	//stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
 	bool init();
 	bool re_init_line(std::vector<vec3> &points);
+	// uploads points from index first on, the buffer is kept while it is big enough
+	bool update_line(const std::vector<vec3> &points, int first);
 	void draw(mat4 &P, mat4 &V, vec3 &colorvec3);
 	bool is_active();
 	void reset();
 
 private:
 	int segment_count = 0;
+	int capacity = 0;			// points the position buffer holds
 	unsigned int posBufID = 0;	
-	unsigned int vaoID;
+	unsigned int vaoID = 0;
 	unsigned int pid;
 	unsigned int ucolor,uP,uV;
 };
 void cardinal_curve(vector<vec3> &result_path, vector<vec3> &original_path, int lod, float curly);
+// tangents of the cardinal spline through points, segment i is the bezier curve
+// points[i], points[i] + tangents[i], points[i + 1] - tangents[i + 1], points[i + 1]
+void cardinal_tangents(vector<vec3> &tangents, const vector<vec3> &points, float curly);
+
+// Cardinal spline that keeps its solver state between edits, so an edit only redoes the
+// part of the curve it changes. The tangents are coupled through the tridiagonal solve,
+// but a change falls off by about 0.27 per point, so the forward sweep and the back
+// substitution stop once the values move less than a tolerance. curve() holds the same
+// samples cardinal_curve makes.
+class CardinalSpline
+{
+public:
+	CardinalSpline(int lod = 61, float curly = 1.0f) : lod(lod), curly(curly) {}
+
+	void set(const vector<vec3> &points);
+	void append(const vec3 &point) { insert(pts.size(), point); }
+	void insert(int index, const vec3 &point);
+	void move(int index, const vec3 &point);
+	void erase(int index);
+
+	int size() const { return pts.size(); }
+	const vector<vec3> &points() const { return pts; }
+	const vector<vec3> &tangents() const { return d; }
+	const vector<vec3> &curve() const { return samples; }	// empty below 3 points
+	int curve_index(int segment) const { return 1 + segment * (lod - 1); }	// first sample of the segment
+
+	// segments the last edit resampled, the samples before curve_index(first_changed) stayed
+	int first_changed = 0, last_changed = -1;
+
+private:
+	// point index is where the points changed, inserted or erased (shift > 0 or < 0)
+	void solve(int index, int shift, bool full);
+	void sample(int first, int last);
+
+	int lod;
+	float curly;
+	vector<vec3> pts, d;
+	vector<vec3> A;				// forward sweep of the solve, kept for the next edit
+	vector<double> Bi;
+	vector<vec4> B;				// bernstein weights of the lod samples
+	vector<vec3> samples;
+};
 
 #endif // LAB471_SHAPE_H_INCLUDED
@@ -21,11 +21,24 @@
 #include "Camera.h"
 #include "line.h"
 #include "ControlPoint.h"
+#include "ArcPath.h"
+#include "PathFollowers.h"
 #include "bone.h"
+#include "anim_file.h"
+#include "clip_library.h"
+#include "skeleton.h"
+#include "blend_tree.h"
+#include "palette_buffer.h"
+#include "anim_instance.h"
+#include "anim_vat.h"
+#include "vat_texture.h"
 
 
 #define MESHSIZE 100		// terrain
 #define	FRAMES 61			// plane animation
+#define CROWD_SIZE 10000	// dragons animated in crowd mode
+#define CROWD_DRAWN 64		// dragons of the GPU crowd drawn as skulls
+#define VAT_UNIT 2			// texture unit of the vertex animation texture, 0 and 1 hold the terrain
 
 using namespace std;
 using namespace glm;
@@ -61,20 +74,39 @@ public:
 		bool switchAnim = false;
 		bool slowMo = false;
 		bool speedUp = false;
+		bool crowdMode = false;
+		bool vatCrowd = false;		// the crowd plays from dragon_vat on the GPU
     glm::vec2 mouseMoveOrigin = glm::vec2(0);
     glm::vec3 mouseMoveInitialCameraRot;
 
 
 		//FBX animation
-		GLuint VAO, VBO, VBO2;
+		GLuint VBO;
+		vector<GLuint> lodVAO, lodVBO2;	// per skeleton lod level, bone indices rebound to the kept joints
+		int skullJoint = 10;		// the head, bone 10 of the dragon file
 		bone *root = NULL;
+		skeleton dragon_skel;
+		palette_buffer dragon_palette;
+		int palette_version = -1;	// pose_version of the dragon in dragon_palette
+		blend_tree dragon_blend;	// prototype of every dragon instance
+		int blend_inter = -1;		// fly <-> run parameter of dragon_blend
+		int head_layer = -1;		// additive layer of dragon_blend on the neck and head
+		bool headLayer = false;		// H toggles it
+		float dragon_inter = 0;
+		thread_pool anim_workers;
+		instance_pool dragons{dragon_skel, anim_workers};
+		int hero = -1;				// the dragon on the path, instance 0
+		vector<vec3> crowd_walk;	// root motion every crowd dragon covered, kept inside its grid cell
+		anim_vat dragon_vat;		// baked palettes of all clips
+		vat_texture dragon_vat_tex;
+		int vat_clip_id = 1;		// clip the GPU crowd plays
+		vector<float> crowd_time, crowd_speed;	// GPU crowd, position 0..1 in the clip
 		int boneCount = 0;
-		vector<mat4> animMats;
 		int currentKeyframe = 0;
-		mat4 animmat[200];
-		mat4 animbones[200];
 		int animmatsize=0;
+		anim_file dragon_anim;		// all_animation maps its keys
 		all_animations all_animation;
+		clip_library dragon_clips;
 
     // terrain
     GLuint VertexArrayID;
@@ -83,10 +115,15 @@ public:
 
    	// paths
 	Line path1_render, campath_render, campath_inverse_render;
-	vector<vec3> path1, campath, campath_inverse, path1_cardinal, camcardinal, camcardinal_inverse;
+	vector<vec3> path1, campath, campath_inverse, camcardinal, camcardinal_inverse;
+	CardinalSpline path1_spline{ FRAMES, 1.0f };	// path1 curve, rebuilt only around new points
 
 	// pos, lookat, up - data
 	vector<mat3> path1_controlpts, campath_controlpts;
+	ArcPath path1_arc;			// path1 by arc length, what the dragon flies
+	ArcPath campath_arc;
+	PathFollowers followers;	// everything that flies a path
+	int heroFollower = -1, camFollower = -1;
 
 	// toggle plane camera perspective
 	int cam_persp = 0;		// toggle camera perspective
@@ -129,17 +166,21 @@ public:
 			cout << "point position:" << pos.x << "," << pos.y << "," << pos.z << endl;
 			cout << "Zbase:" << dir.x << "," << dir.y << "," << dir.z << endl;
 			cout << "Ybase:" << up.x << "," << up.y << "," << up.z << endl;
-			cout << "point saved into ofile!" << endl << endl;
+			cout << "point saved into journal!" << endl << endl;
 			cout << endl;
 
-			Path1_CP->addPoint(pos, up, dir, resourceDir + "/path1.txt");
+			Path1_CP->addPoint(pos, up, dir, resourceDir + "/path1.journal");
 
 			path1.push_back(Path1_CP->points[Path1_CP->getSize() - 1][0]);		// add point to line
-			path1_render.re_init_line(path1);
-			cardinal_curve(path1_cardinal, path1, FRAMES, 1.0);
-			path1_render.re_init_line(path1_cardinal);
+			path1_spline.append(path1.back());
+			path1_render.update_line(path1_spline.curve(), path1_spline.curve_index(path1_spline.first_changed));
+			path1_arc.update(path1_spline, Path1_CP->points);
 
 		}
+		if (key == GLFW_KEY_E && action == GLFW_PRESS) {
+			if (Path1_CP->exportPoints(resourceDir + "/path1.txt"))
+				cout << Path1_CP->getSize() << " points exported to path1.txt" << endl;
+		}
 		if (key == GLFW_KEY_BACKSPACE && action == GLFW_PRESS) {
 			cout << "Going to last point" << endl;
 			mat3 newpt = Path1_CP->goToLastPoint();
@@ -155,6 +196,23 @@ public:
 		if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
 			speedUp = !speedUp;
 		}
+		if (key == GLFW_KEY_C && action == GLFW_PRESS && hero >= 0) {
+			crowdMode = !crowdMode;
+			setCrowd(crowdMode ? CROWD_SIZE : 1);
+		}
+		if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+			for (int b = 0; b < dragons.bands.size(); b++)
+				cout << "band " << b << " (" << dragons.bands[b].max_distance << ", every " << dragons.bands[b].interval << " frames): " << dragons.bands[b].instances << " dragons, "
+					<< dragons.bands[b].updates << " updated, " << dragons.bands[b].extrapolated << " extrapolated" << endl;
+			cout << dragons.offscreen << " off screen, " << dragons.poses_evaluated << " poses evaluated" << endl;
+		}
+		if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+			headLayer = !headLayer;
+		}
+		if (key == GLFW_KEY_V && action == GLFW_PRESS && dragon_vat_tex.is_loaded()) {
+			vatCrowd = !vatCrowd;
+			setVatCrowd(vatCrowd ? CROWD_SIZE : 0);
+		}
 
         // Polygon mode (wireframe vs solid)
         if (key == GLFW_KEY_P && action == GLFW_PRESS) {
@@ -364,6 +422,7 @@ public:
 		//campath_render.re_init_line(campath);
 		//cardinal_curve(camcardinal, campath, FRAMES, 1.0);
 		//campath_render.re_init_line(camcardinal);
+		//campath_arc.build(campath_controlpts);
 		//cout << "cam path has: " << campath.size() << " points" << endl;
 
 		//// campath - inverse (drawing purposes)
@@ -378,44 +437,153 @@ public:
 			path1.push_back(Path1_CP->points[i][0]);
 			//	cout << path1_controlpts[i][0].x << " " << path1_controlpts[i][0].y << " " << path1_controlpts[i][0].z << endl;
 		}
-		path1_render.re_init_line(path1);
-		cardinal_curve(path1_cardinal, path1, FRAMES, 1.0);
-		path1_render.re_init_line(path1_cardinal);
+		path1_spline.set(path1);
+		path1_render.update_line(path1_spline.curve(), 0);
+		path1_arc.update(path1_spline, Path1_CP->points);
+
+		cout << "path 1 has: " << path1.size() << " points, " << path1_arc.getLength() << " units\n" << endl;
+
+		followers.clear();
+		int path1Id = followers.addPath(&path1_arc);
+		int campathId = followers.addPath(&campath_arc);
+		heroFollower = followers.add(path1Id);
+		camFollower = followers.add(campathId);
+	}
+
+	// the hero flies the path, the crowd stands in a grid behind it
+	glm::mat4 crowdPlace(int d) {
+		if (d == 0)
+			return mat4(1);
+		vec3 walk = d < crowd_walk.size() ? crowd_walk[d] : vec3(0);
+		return translate(mat4(1), vec3((d % 100) * 4.0f - 200.0f, 0, (d / 100) * 4.0f + 4.0f) + walk);
+	}
 
-		cout << "path 1 has: " << path1.size() << " points\n" << endl;
+	// true if a sphere around p may be in the view of PV
+	bool inView(const glm::mat4 &PV, const glm::vec3 &p, float radius) {
+		vec4 c = PV * vec4(p, 1);
+		float w = c.w + radius;
+		return w > 0 && fabs(c.x) <= w && fabs(c.y) <= w && c.z <= w;
+	}
+
+	// grows or shrinks the dragons to count, new ones start at a random phase and speed
+	void setCrowd(int count) {
+		if (dragons.size() > count)
+		{
+			dragons.clear();
+			hero = dragons.add(dragon_blend);
+			palette_version = -1;
+		}
+		while (dragons.size() < count)
+		{
+			anim_instance &inst = dragons[dragons.add(dragon_blend)];
+			inst.blend.phase = rand() / (double)RAND_MAX;
+			inst.blend.time_ms = inst.blend.phase * dragon_skel.clip_length_ms(1);
+			inst.speed = 0.8f + 0.4f * rand() / (float)RAND_MAX;
+		}
+		crowd_walk.assign(dragons.size(), vec3(0));
+		cout << dragons.size() << " dragons on " << anim_workers.size() << " workers" << endl;
+	}
+
+	// the GPU crowd only keeps a time and a speed per dragon
+	void setVatCrowd(int count) {
+		crowd_time.resize(count);
+		crowd_speed.resize(count);
+		for (int d = 0; d < count; d++)
+		{
+			crowd_time[d] = rand() / (float)RAND_MAX;
+			crowd_speed[d] = 0.8f + 0.4f * rand() / (float)RAND_MAX;
+		}
+		cout << count << " dragons played from the vertex animation texture" << endl;
 	}
 
 	void initAnim(const std::string& resourceDirectory) {
-		// Read FBX file
+		// Map the skeleton and clips baked from CompleteRiggedDragonFly.fbx and CompleteRiggedDragonRun.fbx:
+		// anim_bake dragon.anim CompleteRiggedDragonFly.fbx CompleteRiggedDragonRun.fbx
+		// with -root-motion <bone> before dragon.anim the clips play in place and the crowd walks
 			std::vector<glm::vec3> boneVertices;
 			std::vector<unsigned int> indexBuffer;
-			for (int ii = 0; ii < 200; ii++)
-				animbones[ii]=animmat[ii] = mat4(1);
-			//readtobone(resourceDirectory + "/test.fbx", &all_animation, &root);
-			readtobone(resourceDirectory + "/CompleteRiggedDragonFly.fbx", &all_animation, &root);
-			readtobone(resourceDirectory + "/CompleteRiggedDragonRun.fbx", &all_animation, NULL);
+			if (!dragon_anim.open(resourceDirectory + "/dragon.anim"))
+			{
+				cout << "dragon.anim missing, bake it with anim_bake" << endl;
+				return;
+			}
+			root = dragon_anim.make_bones();
+			if (!root)
+			{
+				cout << "dragon.anim has no bones, bake it again" << endl;
+				return;
+			}
+			dragon_anim.add_clips(&all_animation);
 //        readtobone(&root, (resourceDirectory + "/test.fbx").c_str(), animations);
 //        readtobone(&root, (resourceDirectory + "/axisneurontestfile_binary.fbx").c_str());
+			dragon_clips.build(&all_animation);
+			for (int c = 0; c < dragon_clips.clip_count(); c++)
+				cout << "clip " << c << ": " << dragon_clips.clip_names[c] << ", " << dragon_clips.clip_frames[c] << " frames, " << dragon_clips.clip_duration[c] << " ms" << endl;
+			root->set_animations(dragon_clips, animmatsize);
+			dragon_skel.load_rig(resourceDirectory + "/dragon.rig");
+			dragon_skel.build(root);
+			skullJoint = dragon_skel.size() > 10 ? dragon_skel.depth_first[10] : 0;
+			for (int l = 0; l < dragon_skel.lod_levels; l++)
+				cout << "skeleton lod " << l << ": " << dragon_skel.lod_joints(l) << " joints" << endl;
 			root->write_to_VBOs(glm::vec3(0), boneVertices, indexBuffer);
-			root->set_animations(&all_animation,animmat, animbones,animmatsize);
+
+			// crossfade between the second takes of the fly and the run file
+			blend_inter = dragon_blend.add_param(0);
+			vector<int> takes;
+			takes.push_back(dragon_blend.add_clip(1));
+			takes.push_back(dragon_blend.add_clip(3));
+			vector<float> thresholds;
+			thresholds.push_back(0);
+			thresholds.push_back(1);
+			dragon_blend.root = dragon_blend.add_blend1d(blend_inter, takes, thresholds);
+			// the first fly take moves the head on top of either, masked to the joints below the neck
+			vector<float> headMask(dragon_skel.size(), 0.f);
+			int neck = dragon_skel.parent[skullJoint] >= 0 ? dragon_skel.parent[skullJoint] : skullJoint;
+			for (int j = 0; j < dragon_skel.size(); j++)
+				for (int a = j; a >= 0 && headMask[j] == 0; a = dragon_skel.parent[a])
+					if (a == neck)
+						headMask[j] = 1;
+			head_layer = dragon_blend.add_layer(0, 0, dragon_blend.add_mask(headMask));
+			// dragons within one frame of the cycle share their pose
+			dragon_blend.quantum_ms = 1000.0 / 60.0;
+			hero = dragons.add(dragon_blend);
+			// full rate and all joints up close, then every 2nd, 4th and 8th frame with fewer joints
+			dragons.bands.push_back(lod_band(30, 1, 0));
+			dragons.bands.push_back(lod_band(80, 2, 1));
+			dragons.bands.push_back(lod_band(200, 4, 2));
+			dragons.bands.push_back(lod_band(400, 8, 3));
+			dragon_palette.init();
+			// vat_bake -rig dragon.rig dragon.anim dragon.vat
+			if (dragon_vat.load(resourceDirectory + "/dragon.vat") && dragon_vat.joints == dragon_skel.size() && vat_clip_id < dragon_vat.clips.size())
+				dragon_vat_tex.upload(dragon_vat);
 //        root->findAnimations(animations[0]);
 //        root->assignMatrix(&animMats);
 			boneCount = boneVertices.size();
 
-			glGenVertexArrays(1, &VAO);
-			glBindVertexArray(VAO);
-
 			glGenBuffers(1, &VBO);
 			glBindBuffer(GL_ARRAY_BUFFER, VBO);
 			glBufferData(GL_ARRAY_BUFFER, boneVertices.size() * sizeof(glm::vec3), boneVertices.data(), GL_STATIC_DRAW);
-			glEnableVertexAttribArray(0);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-
-			glGenBuffers(1, &VBO2);
-			glBindBuffer(GL_ARRAY_BUFFER, VBO2);
-			glBufferData(GL_ARRAY_BUFFER, indexBuffer.size() * sizeof(unsigned int), indexBuffer.data(), GL_STATIC_DRAW);
-			glEnableVertexAttribArray(3);
-			glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, 0, (const void *)0);
+
+			// one VAO per skeleton lod, the bones of dropped joints follow their kept ancestor
+			lodVAO.resize(dragon_skel.lod_levels);
+			lodVBO2.resize(dragon_skel.lod_levels);
+			glGenVertexArrays(lodVAO.size(), lodVAO.data());
+			glGenBuffers(lodVBO2.size(), lodVBO2.data());
+			for (int l = 0; l < lodVAO.size(); l++)
+			{
+				vector<unsigned int> lodIndex(indexBuffer.size());
+				for (int v = 0; v < indexBuffer.size(); v++)
+					lodIndex[v] = dragon_skel.lod_joint(l, indexBuffer[v]);
+				glBindVertexArray(lodVAO[l]);
+				glBindBuffer(GL_ARRAY_BUFFER, VBO);
+				glEnableVertexAttribArray(0);
+				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
+
+				glBindBuffer(GL_ARRAY_BUFFER, lodVBO2[l]);
+				glBufferData(GL_ARRAY_BUFFER, lodIndex.size() * sizeof(unsigned int), lodIndex.data(), GL_STATIC_DRAW);
+				glEnableVertexAttribArray(3);
+				glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, 0, (const void *)0);
+			}
 }
 	void initGeom(const std::string& resourceDirectory) {
 		init_terrain_mesh();
@@ -463,6 +631,14 @@ public:
         dboneShader->setShaderNames(resourceDirectory + "/dbone.vert", resourceDirectory + "/dbone.frag");
         dboneShader->init();
 
+		// Mvat gets a unit of its own, a sampler left on 0 would clash with the Manim buffer
+		phongShader->bind();
+		phongShader->setInt("Mvat", VAT_UNIT);
+		phongShader->unbind();
+		dboneShader->bind();
+		dboneShader->setInt("Mvat", VAT_UNIT);
+		dboneShader->unbind();
+
         skyprog = std::make_shared<Program>();
         skyprog->setShaderNames(resourceDirectory + "/sky.vert", resourceDirectory + "/sky.frag");
         skyprog->init();
@@ -484,7 +660,10 @@ public:
         pplane->init();
 
 		// init control points -----------
-		Path1_CP->loadPoints(resourceDirectory + "/path1.txt");
+		// the journal has every recorded point, without one the text file is imported
+		string journal = resourceDirectory + "/path1.journal";
+		if (!ifstream(journal).is_open() || !Path1_CP->loadPoints(journal))
+			Path1_CP->loadPoints(resourceDirectory + "/path1.txt");
 		pt_cnt = Path1_CP->points.size();
 
 	}
@@ -495,101 +674,17 @@ public:
         return glm::perspective(fov, aspect, 0.01f, 10000.0f);
     }
 
-    mat4 linint_between_two_orientations(vec3 ez_lookto_1, vec3 ey_up_1, vec3 ez_lookto_2, vec3 ey_up_2, float t) {
-		mat4 m1, m2;
-		quat q1, q2;
-		vec3 ex, ey, ez;
-
-		t = ((-cos(t* 3.14)) + 1) / 2.0;	// smooth transition
-
-		// get rotation matrix ---------
-		ey = ey_up_1;											// control point 1
-		ez = ez_lookto_1;
-		ex = cross(ey, ez);
-		m1[0][0] = ex.x;	m1[1][0] = ey.x;	m1[2][0] = ez.x;	m1[3][0] = 0;
-		m1[0][1] = ex.y;	m1[1][1] = ey.y;	m1[2][1] = ez.y;	m1[3][1] = 0;
-		m1[0][2] = ex.z;	m1[1][2] = ey.z;	m1[2][2] = ez.z;	m1[3][2] = 0;
-		m1[0][3] = 0;		m1[1][3] = 0;		m1[2][3] = 0;		m1[3][3] = 1.0f;
-		ey = ey_up_2;											// control point 2
-		ez = ez_lookto_2;
-		ex = cross(ey, ez);
-		m2[0][0] = ex.x;	m2[1][0] = ey.x;	m2[2][0] = ez.x;	m2[3][0] = 0;
-		m2[0][1] = ex.y;	m2[1][1] = ey.y;	m2[2][1] = ez.y;	m2[3][1] = 0;
-		m2[0][2] = ex.z;	m2[1][2] = ey.z;	m2[2][2] = ez.z;	m2[3][2] = 0;
-		m2[0][3] = 0;		m2[1][3] = 0;		m2[2][3] = 0;		m2[3][3] = 1.0f;
-
-		// Convert to quarternion -------
-		q1 = quat(m1);
-		q2 = quat(m2);
-
-		// Interpolate ------------------
-		quat qt = slerp(q1, q2, t);
-		qt = normalize(qt);
-
-		// Convert back to Matrix -------
-		mat4 mt = mat4(qt);
-
-		return mt;
-	}
-
-	mat4 TranslateObjAlongPath(float frametime,  vector<vec3> path, vector<mat3> controlpts) {
-		mat4 TransPlane1, RotPlane1;
-		// Translate Plane Along Path
-		if (controlpts.size() < 3) return mat4(0.0);
-		static float sumft = 0; // sum of frame times
-		sumft += frametime;
-		float f = sumft * FRAMES;
-		int frame = f;
-		if (frame >= path.size() - 1) {								// loop through path
-			sumft = 0;
-			frame = 0;
-		}
-
-		// Rotate Plane Along Path
-		vec3 ez1, ey1, ez2, ey2;							// zbase and ybase vectors for two contorl points
-		static float t = 0.0;								// t for interpoltation
-		t = (float)(frame % (FRAMES - 1)) / (float)(FRAMES - 1);
-
-		ey1 = ey2 = controlpts[frame / (FRAMES - 1)][1];				// ey1 - up
-		ez1 = ez2 = controlpts[frame / (FRAMES - 1)][2];				// ez1 - look at
-
-		if ((frame / (FRAMES - 1)) + 1 < controlpts.size()) {		// check if the next control pt exists
-			ey2 = controlpts[(frame / (FRAMES - 1)) + 1][1];		// ey2 - up
-			ez2 = controlpts[(frame / (FRAMES - 1)) + 1][2];		// ez2 - look at
-		}
-		RotPlane1 = linint_between_two_orientations(ez1, ey1, ez2, ey2, t);
-		TransPlane1 = glm::translate(glm::mat4(1.0f), path[frame]);
-
-		return TransPlane1 * RotPlane1;
+	// distance per second of the old sample stepping, one segment per (FRAMES - 1) / FRAMES seconds
+	float pathPace(const ArcPath &path) {
+		return path.isValid() ? FRAMES / (FRAMES - 1.0f) * path.getLength() / path.getSegments() : 0.0f;
 	}
 
-	mat4 CamPathView(float frametime) {
-		// Translate Plane Along Path
-		static float sumft = 0; // sum of frame times
-		sumft += frametime;
-		float f = sumft * FRAMES;
-		int frame = f;
-		if (frame >= camcardinal.size() - 1) {								// loop through path
-			sumft = 0;
-			frame = 0;
-		}
-
-		camera->pos = camcardinal[frame];
-
-		float t = 0.0;
-		t = (float)(frame % (FRAMES - 1)) / (float)(FRAMES - 1);
-		vec3 ez1, ey1, ez2, ey2;
-		ez1 = ez2 = campath_controlpts[frame / (FRAMES - 1)][1];				// ez1 - up
-		ey1 = ey2 = campath_controlpts[frame / (FRAMES - 1)][2];				// ey1 - lookat
-
-		if ((frame / (FRAMES - 1)) + 1 < campath_controlpts.size()) {		// check if the next control pt exists
-			ez2 = campath_controlpts[(frame / (FRAMES - 1)) + 1][1];		// ez2 - up
-			ey2 = campath_controlpts[(frame / (FRAMES - 1)) + 1][2];		// ey2 - lookat
-		}
-
-		mat4 RotPlane = linint_between_two_orientations(ez1, ey1, ez2, ey2, t);
-		mat4 TransPlane = glm::translate(mat4(1.0), camcardinal[frame]);
-		return transpose(RotPlane) * TransPlane;
+	// view from the camera follower
+	mat4 CamPathView() {
+		if (!campath_arc.isValid()) return camera->getViewMatrix();
+		const mat4 &frame = followers.getTransform(camFollower);
+		camera->pos = vec3(frame[3]);
+		return inverse(frame);
 	}
 
 	void render() {
@@ -600,12 +695,21 @@ public:
 		glClearColor(0.3f, 0.7f, 0.8f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		// the hero flies at half the pace of the old sample stepping, its bones and lines
+		// used to share one accumulator that added up to about that. With clips baked in
+		// place it flies as far as its root motion says, a frame late.
+		float heroWalk = hero >= 0 ? length(dragons[hero].blend.root_delta) : 0.0f;
+		followers.speed[heroFollower] = heroWalk > 0 ? 0.0f : pathPace(path1_arc) / 2.0f;
+		followers.distance[heroFollower] += heroWalk;
+		followers.speed[camFollower] = pathPace(campath_arc);
+		followers.update(frametime);
+
 		// Create the matrix stacks.
 		glm::mat4 V, M, P;
         P = getPerspectiveMatrix();
         V = camera->getViewMatrix();
 		// if (cam_persp) {
-		// 	V = CamPathView(frametime);
+		// 	V = CamPathView();
 		// }
         M = glm::mat4(1);
 
@@ -724,103 +828,134 @@ public:
 
 
 		//anim ish *******************************************************
-		static double totaltime_ms=0;
-		totaltime_ms += frametime*1000.0;
-		static double totaltime_untilframe_ms = 0;
-		totaltime_untilframe_ms += frametime*1000.0;
-
 		P = getPerspectiveMatrix();
 	V = camera->getViewMatrix();
 	M = glm::mat4(1);
 
 	// Setup Animation
-	string animationName = "";
-	int animIdx = 0;
-	if (!switchAnim)
-	{
-		animationName = "ArmatureAction";
-		animIdx = 0;
-	}
-	else
+	double anim_dt_ms = frametime*1000.0;
+	if (slowMo)
+		anim_dt_ms *= 0.1;
+	else if (speedUp)
+		anim_dt_ms *= 3.0;
+
+	S = glm::scale(glm::mat4(1), glm::vec3(1.0f));
+	glm::mat4	T = glm::translate(glm::mat4(1), glm::vec3(0, 0, 0));
+	glm::mat4 pathMB = followers.getTransform(heroFollower); // bones and lines
+
+	// the level of detail of every dragon follows its distance to the camera and a rough view test
+	glm::mat4 PV = P * V;
+	dragons.viewer = vec3(inverse(V)[3]);
+	for (int d = 0; d < dragons.size(); d++)
 	{
-		animationName = "ArmatureAction2";
-		animIdx = 1;
+		dragons[d].blend.params[blend_inter] = dragon_inter;
+		dragons[d].blend.layers[head_layer].weight = headLayer ? 1.0f : 0.0f;
+		dragons[d].position = vec3(pathMB * crowdPlace(d)[3]);
+		dragons[d].visible = inView(PV, dragons[d].position, 5.0f);
 	}
-	for (int ii = 0; ii < 200; ii++)
-			animmat[ii] = mat4(1);
-	long long animationDuration = root->getDuration("ArmatureAction");
-	int keyFrameCount = root->getKeyFrameCount("ArmatureAction");
-	int anim_step_width_ms = animationDuration / keyFrameCount;
-	static float frame = 0;
-	//static float fframe = 0;
-	if (totaltime_untilframe_ms >= anim_step_width_ms)
+	dragons.update(anim_dt_ms);
+	// clips baked in place hand their travel out as root deltas, the crowd walks by them
+	for (int d = 1; d < crowd_walk.size() && d < dragons.size(); d++)
 	{
-			totaltime_untilframe_ms = 0;
-			if (slowMo)
-			{
-				frame += 0.1f;
-			}
-			else if (speedUp)
-			{
-				frame+=3;
-			}
-			else
-			{
-				frame++;
-			}
+		crowd_walk[d] += dragons[d].blend.root_delta;
+		crowd_walk[d] -= 4.0f * floor((crowd_walk[d] + 2.0f) / 4.0f);
 	}
-	if (frame >= 24)
+	if (!crowd_time.empty())
 	{
-		frame = 0;
+		float clip_steps = anim_dt_ms / dragon_vat.clips[vat_clip_id].length_ms;
+		for (int d = 0; d < crowd_time.size(); d++)
+			crowd_time[d] = fract(crowd_time[d] + clip_steps * crowd_speed[d]);
 	}
-
-	static float inter = 0;
-
-	root->play_animation(frame, animationName, inter);
-	if (switchAnim && inter < 1)
+	if (switchAnim && dragon_inter < 1)
 	{
-		inter += frametime;
+		dragon_inter += frametime;
 	}
-	else if (!switchAnim && inter > 0)
+	else if (!switchAnim && dragon_inter > 0)
 	{
-		inter -= frametime;
+		dragon_inter -= frametime;
 	}
+	if (hero < 0)
+		return;
+	const skeleton_pose &pose = dragons.pose(hero);
+	int heroLod = std::min(dragons.lod(hero), (int)lodVAO.size() - 1), heroJoints = dragons.joints(hero);
 
 	/**************/
 	/* DRAW SHAPE */
 	/**************/
-	S = glm::scale(glm::mat4(1), glm::vec3(1.0f));
-	glm::mat4	T = glm::translate(glm::mat4(1), glm::vec3(0, 0, 0));
-	glm::mat4 pathMB = TranslateObjAlongPath(frametime/258.0, path1_cardinal, Path1_CP->points); //bones
-	glm::mat4 pathML = TranslateObjAlongPath(frametime/2.0, path1_cardinal, Path1_CP->points); // lines
-	M = pathML * S;
+	M = pathMB * S;
 	phongShader->bind();
 	phongShader->setMVP(&M[0][0], &V[0][0], &P[0][0]);
-	phongShader->setMatrixArray("Manim", 200, &animmat[0][0][0]);
+	if (palette_version != pose.pose_version)
+	{
+		dragon_palette.upload(pose.palette, heroJoints);
+		palette_version = pose.pose_version;
+	}
+	dragon_palette.bind(0);
+	phongShader->setInt("Manim", 0);
 
 
-	glBindVertexArray(VAO);
-	glDrawArrays(GL_LINES, 0, boneCount-4);
+	if (boneCount > 4)
+	{
+		glBindVertexArray(lodVAO[heroLod]);
+		glDrawArrays(GL_LINES, 0, boneCount-4);
+	}
 	phongShader->unbind();
 
 	dboneShader->bind();
-	for (int i=0;i<129;i++)
+	for (int d=0;d<dragon_skel.drawn.size();d++)
 	{
-		if (i==10)
+		int i = dragon_skel.drawn[d];
+		if (i >= heroJoints)
+			break;
+		if (i==skullJoint)
 	  {
 			glm::mat4 R = glm::rotate(mat4(1),glm::radians(180.0f), glm::vec3(0,1,0))*  glm::rotate(mat4(1),glm::radians(90.0f), glm::vec3(0,0,1));
-		 	M =  pathMB * animbones[10]*  R *  scale(mat4(1), vec3(0.6, 0.6, 0.6));
+		 	M =  pathMB * pose.world_bone[skullJoint]*  R *  scale(mat4(1), vec3(0.6, 0.6, 0.6));
 		 	dboneShader->setMVP(&M[0][0], &V[0][0], &P[0][0]);
 		 	skull ->draw(dboneShader,false);
 	  }
 		else
 		{
-			M = pathMB * animbones[i]*  translate(mat4(1), vec3(0.5, 0, 0))*scale(mat4(1), vec3(0.4, 0.4, 0.4));
+			M = pathMB * pose.world_bone[i]*  translate(mat4(1), vec3(0.5, 0, 0))*scale(mat4(1), vec3(0.4, 0.4, 0.4));
 			dboneShader->setMVP(&M[0][0], &V[0][0], &P[0][0]);
 			dbone->draw(dboneShader,false);
 		}
 	}
 
+	// the crowd only shows the skulls of the visible dragons in the nearest band
+	glm::mat4 R = glm::rotate(mat4(1),glm::radians(180.0f), glm::vec3(0,1,0))*  glm::rotate(mat4(1),glm::radians(90.0f), glm::vec3(0,0,1));
+	for (int d = 1; d < dragons.size(); d++)
+	{
+		if (!dragons[d].visible || dragons[d].band != 0)
+			continue;
+		M = pathMB * crowdPlace(d) * dragons.pose(d).world_bone[skullJoint] * R * scale(mat4(1), vec3(0.6, 0.6, 0.6));
+		dboneShader->setMVP(&M[0][0], &V[0][0], &P[0][0]);
+		skull->draw(dboneShader,false);
+	}
+
+	// the GPU crowd sends one time per dragon, the shader finds the skull joint in the texture
+	if (!crowd_time.empty())
+	{
+		const vat_clip &clip = dragon_vat.clips[vat_clip_id];
+		float len = length(dragon_skel.rest_trans[skullJoint]);
+		glm::mat4 Mbone = scale(mat4(1), vec3(len, len, len)) * R * scale(mat4(1), vec3(0.6, 0.6, 0.6));
+		dragon_vat_tex.bind(VAT_UNIT);
+		dboneShader->setInt("vatFirst", clip.first_frame);
+		dboneShader->setInt("vatFrames", clip.frames);
+		dboneShader->setInt("vatJoint", skullJoint);
+		dboneShader->setMatrix("Mbone", &Mbone[0][0]);
+		for (int d = 0; d < crowd_time.size() && d < CROWD_DRAWN; d++)
+		{
+			glm::mat4 grid = translate(mat4(1), vec3((d % 8) * 4.0f - 16.0f, 0, -(d / 8) * 4.0f - 4.0f));
+			M = pathMB * grid;
+			dboneShader->setMVP(&M[0][0], &V[0][0], &P[0][0]);
+			dboneShader->setFloat("vatTime", crowd_time[d]);
+			skull->draw(dboneShader,false);
+		}
+		dboneShader->setInt("vatFrames", 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
 };
 };
 
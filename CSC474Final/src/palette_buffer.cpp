@@ -0,0 +1,40 @@
+#include "palette_buffer.h"
+#include "GLSL.h"
+
+using namespace std;
+using namespace glm;
+
+void palette_buffer::init()
+{
+	glGenBuffers(1, &bufID);
+	glGenTextures(1, &texID);
+	capacity = 0;
+	joints = 0;
+}
+
+void palette_buffer::upload(const vector<vec4> &rows, int count)
+{
+	joints = count;
+	int used = count * 3;
+	if (used <= 0 || used > (int)rows.size()) return;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, bufID);
+	if (used > capacity)
+	{
+		capacity = used;
+		glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(vec4), rows.data(), GL_DYNAMIC_DRAW);
+		// the texture has to be attached again after the storage changed
+		glBindTexture(GL_TEXTURE_BUFFER, texID);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, bufID);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	else
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, used * sizeof(vec4), rows.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void palette_buffer::bind(int unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_BUFFER, texID);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#ifndef LAB474_PALETTE_BUFFER_H_INCLUDED
+#define LAB474_PALETTE_BUFFER_H_INCLUDED
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Matrix palette on the GPU as a texture buffer of RGBA32F texels, 3 texels (the rows
+// of a 3x4 affine matrix) per joint. Read in the shader with a samplerBuffer and
+// texelFetch, so the joint count is not limited by the uniform space.
+class palette_buffer
+{
+public:
+	void init();
+	// copies the first joints * 3 rows, the buffer only grows
+	void upload(const std::vector<glm::vec4> &rows, int joints);
+	// binds the texture to the texture unit, set the sampler uniform to the same unit
+	void bind(int unit);
+	int size() const { return joints; }
+
+private:
+	unsigned int bufID = 0;
+	unsigned int texID = 0;
+	int capacity = 0;		// rows the buffer has room for
+	int joints = 0;
+};
+
+#endif // LAB474_PALETTE_BUFFER_H_INCLUDED
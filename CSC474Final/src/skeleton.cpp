@@ -0,0 +1,248 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include "skeleton.h"
+#include "anim_sampler.h"
+
+using namespace std;
+using namespace glm;
+
+skeleton::skeleton()
+{
+	const char *control[] = { "ctrl", "pt", "control", "Control" };
+	const char *helper[] = { "Armature", "dragon2" };
+	for (int i = 0; i < 4; i++)
+		rig_rules.push_back(rig_rule{ BONE_CONTROL, control[i], 0 });
+	for (int i = 0; i < 2; i++)
+		rig_rules.push_back(rig_rule{ BONE_HELPER, helper[i], 0 });
+	rig_rules.push_back(rig_rule{ BONE_HIDDEN, "Bone_002", 0 });
+}
+
+bool skeleton::load_rig(const string &filename)
+{
+	ifstream file(filename);
+	if (!file.is_open())
+	{
+		cout << "Warning: Could not open rig description - " << filename << endl;
+		return false;
+	}
+
+	vector<rig_rule> rules;
+	string line;
+	while (getline(file, line))
+	{
+		size_t comment = line.find('#');
+		if (comment != string::npos)
+			line.erase(comment);
+		istringstream in(line);
+		string kind, pattern;
+		int level = 0;
+		if (!(in >> kind) || (kind == "lod" && !(in >> level)) || !(in >> pattern))
+			continue;
+
+		rig_rule rule;
+		rule.pattern = pattern;
+		rule.flag = 0;
+		rule.lod = 0;
+		if (kind == "lod") rule.lod = std::max(level, 1);
+		else if (kind == "control") rule.flag = BONE_CONTROL;
+		else if (kind == "helper") rule.flag = BONE_HELPER;
+		else if (kind == "hidden") rule.flag = BONE_HIDDEN;
+		else
+		{
+			cout << "Warning: unknown bone class " << kind << " in " << filename << endl;
+			continue;
+		}
+		rules.push_back(rule);
+	}
+	rig_rules = rules;
+	return true;
+}
+
+static unsigned char classify(const vector<rig_rule> &rules, const string &name, int &lod)
+{
+	unsigned char flag = 0;
+	for (int r = 0; r < rules.size(); r++)
+		if (name.find(rules[r].pattern) != string::npos)
+		{
+			flag |= rules[r].flag;
+			if (rules[r].lod > 0)
+				lod = std::min(lod, rules[r].lod - 1);
+		}
+	return flag;
+}
+
+// depth first, parent before kids
+static void flatten(bone *b, int parentindex, vector<bone*> &bones, vector<int> &parents)
+{
+	int index = bones.size();
+	bones.push_back(b);
+	parents.push_back(parentindex);
+	for (int i = 0; i < b->kids.size(); i++)
+		flatten(b->kids[i], index, bones, parents);
+}
+
+void skeleton::build(bone *root)
+{
+	names.clear();
+	parent.clear();
+	rest_trans.clear();
+	flags.clear();
+	drawn.clear();
+	depth_first.clear();
+	lod_size.clear();
+	lod_keep.clear();
+	clip_count = 0;
+
+	vector<bone*> order;
+	vector<int> parents;
+	if (root)
+		flatten(root, -1, order, parents);
+	int n = order.size();
+
+	// height of every subtree and whether it has a drawn bone
+	vector<unsigned char> bone_flags(n);
+	vector<int> rule_keep(n, lod_levels - 1), height(n, 0);
+	vector<unsigned char> drawn_below(n);
+	for (int i = 0; i < n; i++)
+	{
+		bone_flags[i] = classify(rig_rules, order[i]->name, rule_keep[i]);
+		drawn_below[i] = !(bone_flags[i] & BONE_NOT_DRAWN);
+	}
+	for (int i = n - 1; i > 0; i--)
+	{
+		height[parents[i]] = std::max(height[parents[i]], height[i] + 1);
+		drawn_below[parents[i]] |= drawn_below[i];
+	}
+
+	// last level that keeps each bone, never more than its parent
+	vector<int> keep(n, lod_levels - 1);
+	for (int i = 1; i < n; i++)
+	{
+		keep[i] = std::min(keep[parents[i]], std::min(height[i], rule_keep[i]));
+		if (!drawn_below[i])
+			keep[i] = 0;
+	}
+
+	// coarser levels first, depth first within a level, so a parent still comes first
+	vector<int> sorted(n);
+	for (int i = 0; i < n; i++)
+		sorted[i] = i;
+	stable_sort(sorted.begin(), sorted.end(), [&](int a, int b) { return keep[a] > keep[b]; });
+	depth_first.resize(n);
+	for (int j = 0; j < n; j++)
+		depth_first[sorted[j]] = j;
+
+	vector<bone*> bones(n);
+	for (int j = 0; j < n; j++)
+	{
+		int i = sorted[j];
+		bones[j] = order[i];
+		order[i]->index = j;
+		names.push_back(order[i]->name);
+		parent.push_back(parents[i] < 0 ? -1 : depth_first[parents[i]]);
+		rest_trans.push_back(order[i]->pos);
+		flags.push_back(bone_flags[i]);
+		lod_keep.push_back(keep[i]);
+		if (!(bone_flags[i] & BONE_NOT_DRAWN))
+			drawn.push_back(j);
+		clip_count = std::max(clip_count, (int)order[i]->animation.size());
+	}
+	for (int l = 0; l < lod_levels; l++)
+		lod_size.push_back(count_if(lod_keep.begin(), lod_keep.end(), [&](int k) { return k >= l; }));
+
+	channels.assign(clip_count * size(), (animation_per_bone*)NULL);
+	for (int j = 0; j < bones.size(); j++)
+		for (int c = 0; c < bones[j]->animation.size(); c++)
+			channels[c * size() + j] = bones[j]->animation[c];
+	// the first joint that carries one, there should only be one
+	motion.assign(clip_count, (animation_per_bone*)NULL);
+	for (int c = 0; c < clip_count; c++)
+		for (int j = 0; j < size() && !motion[c]; j++)
+			if (channel(c, j) && !channel(c, j)->root_motion.empty())
+				motion[c] = channel(c, j);
+}
+
+int skeleton::lod_joint(int level, int joint) const
+{
+	while (parent[joint] >= 0 && lod_keep[joint] < level)
+		joint = parent[joint];
+	return joint;
+}
+
+double skeleton::clip_length_ms(int clip) const
+{
+	double length = 0;
+	for (int j = 0; j < size(); j++)
+		if (channel(clip, j))
+			length = std::max(length, channel_length_ms(*channel(clip, j)));
+	return length;
+}
+
+//**************************************************
+
+void skeleton_pose::bind(const skeleton &skel)
+{
+	int n = skel.size();
+	local_rot = quat_stream();
+	local_trans = vec3_stream();
+	local_rot.resize(n);
+	local_trans.resize(n);
+	for (int i = 0; i < n; i++)
+		local_trans.set(i, skel.rest_trans[i]);
+	world.assign(n, mat4(1));
+	world_bone.assign(n, mat4(0));
+	palette.assign(n * 3, vec4(0));
+	dirty.assign(n, 1);
+	first_dirty = 0;
+}
+
+bool skeleton_pose::evaluate(const skeleton &skel, int count)
+{
+	if (skel.size() != size()) return false;
+	if (count <= 0 || count > size())
+		count = size();
+	if (first_dirty >= count) return false;
+
+	const vector<int> &parent = skel.parent;
+	int start = first_dirty;
+	for (int i = start; i < count; i++)
+	{
+		// parents come first, so a dirty parent has already passed its flag on
+		if (parent[i] >= 0 && dirty[parent[i]])
+			dirty[i] = 1;
+		if (!dirty[i]) continue;
+
+		vec3 tr = local_trans.get(i);
+		mat4 M = translate(mat4(1), tr) * mat4(local_rot.get(i));
+		world[i] = parent[i] < 0 ? M : world[parent[i]] * M;
+
+		// the last row of a rigid transform is always (0,0,0,1), it is left out
+		const mat4 &W = world[i];
+		for (int r = 0; r < 3; r++)
+			palette[i * 3 + r] = vec4(W[0][r], W[1][r], W[2][r], W[3][r]);
+	}
+	for (int d = 0; d < skel.drawn.size(); d++)
+	{
+		int i = skel.drawn[d];
+		if (i >= count) break;
+		if (!dirty[i]) continue;
+		float len = length(local_trans.get(i));
+		world_bone[i] = world[i] * scale(mat4(1), vec3(len, len, len));
+	}
+
+	// the joints past count under a recomputed joint are left for a later evaluate()
+	first_dirty = size();
+	for (int i = count; i < size(); i++)
+	{
+		if (parent[i] >= 0 && dirty[parent[i]])
+			dirty[i] = 1;
+		if (dirty[i] && first_dirty == size())
+			first_dirty = i;
+	}
+	std::fill(dirty.begin() + start, dirty.begin() + count, 0);
+	pose_version++;
+	return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#ifndef LAB474_SKELETON_H_INCLUDED
+#define LAB474_SKELETON_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bone.h"
+#include "anim_simd.h"
+
+// classes of bones that only drive the rig, set once by the rig description
+enum bone_flag
+{
+	BONE_CONTROL = 1,		// IK targets and other controls
+	BONE_HELPER = 2,		// armature and mesh nodes
+	BONE_HIDDEN = 4			// anything else that should not be drawn
+};
+#define BONE_NOT_DRAWN (BONE_CONTROL | BONE_HELPER | BONE_HIDDEN)
+
+// bones whose name contains pattern get flag, and with lod > 0 are dropped from that
+// skeleton lod level on
+struct rig_rule
+{
+	unsigned char flag;
+	string pattern;
+	int lod;
+};
+
+// Flat copy of the bone hierarchy. Joints are sorted so that a parent always comes
+// before its kids, so the whole pose is computed by one forward loop over the arrays
+// instead of the recursion through bone::kids. Read only once built, the pose of every
+// animated instance lives in its own skeleton_pose.
+// Skeletal level of detail: level l keeps the joints [0, lod_size[l]), build() orders the
+// joints so that every level is a prefix and evaluating a level is evaluating the first
+// lod_size[l] joints. Level 0 keeps all joints. Each level drops the joints that are
+// within l joints of the end of their chain, helper branches without drawn bones and
+// what the lod rig rules say, with everything below them.
+class skeleton
+{
+public:
+	vector<string> names;
+	vector<int> parent;					// index of the parent joint, -1 for the root
+	vector<vec3> rest_trans;			// bone::pos, the pose of joints without channels
+	vector<unsigned char> flags;		// bone_flag bits of every joint
+	vector<int> drawn;					// joints without BONE_NOT_DRAWN, in joint order
+	vector<int> depth_first;			// joint of every bone in depth first order, the numbering of the bone files
+
+	int lod_levels = 4;					// levels build() makes
+	vector<int> lod_size;				// joints kept by every level
+	vector<int> lod_keep;				// last level that keeps the joint
+
+	// classification rules applied by build(), the built in ones match the dragon rig
+	vector<rig_rule> rig_rules;
+
+	// channel of every clip and joint at [clip * size() + joint], NULL if the bone has none.
+	// Clips are numbered as in the clip_library the bones were bound to.
+	int clip_count = 0;
+	vector<animation_per_bone*> channels;
+	// channel with the extracted root motion of every clip, NULL for clips that move on their own
+	vector<animation_per_bone*> motion;
+
+	skeleton();
+
+	// reads the rules from a rig description, one "control|helper|hidden <pattern>" or
+	// "lod <level> <pattern>" per line, '#' starts a comment. Returns false and keeps the
+	// current rules if the file can't load.
+	bool load_rig(const string &filename);
+	// flattens the hierarchy below root and renumbers bone::index to the joint index,
+	// so the animation index VBO matches the arrays. Call after bone::set_animations.
+	void build(bone *root);
+
+	int size() const { return (int)parent.size(); }
+	animation_per_bone *channel(int clip, int joint) const { return channels[clip * size() + joint]; }
+	animation_per_bone *root_motion(int clip) const { return motion[clip]; }
+	// longest channel of the clip, the clip loops after it
+	double clip_length_ms(int clip) const;
+	// joints evaluated at the level, levels past the last one take the last one
+	int lod_joints(int level) const { return lod_size.empty() ? size() : lod_size[std::min(std::max(level, 0), (int)lod_size.size() - 1)]; }
+	// the joint itself if the level keeps it, else its nearest ancestor that is kept
+	int lod_joint(int level, int joint) const;
+};
+
+// Pose of one animated instance of a skeleton: the sampled local transforms and the
+// matrices computed from them.
+class skeleton_pose
+{
+public:
+	quat_stream local_rot;				// local rotation of the recent pose
+	vec3_stream local_trans;			// local translation of the recent pose
+	vector<mat4> world;					// animation matrix of every joint
+	vector<mat4> world_bone;			// world matrix scaled by the bone length, for the bone mesh
+	vector<vec4> palette;				// world as 3x4 affine rows, 3 per joint, for the shader
+	vector<unsigned char> dirty;		// local transform changed since the last evaluate()
+	int pose_version = 0;				// counts the evaluate() calls that changed world
+
+	// sizes the arrays for the skeleton and sets the rest pose
+	void bind(const skeleton &skel);
+	// recomputes world, palette and world_bone of the dirty joints and their subtrees, world_bone
+	// stays zero for BONE_NOT_DRAWN. Returns false and leaves everything as is if nothing was dirty.
+	// count > 0 stops after the first count joints, the joints past it that should have
+	// followed stay dirty until an evaluate() that reaches them.
+	bool evaluate(const skeleton &skel, int count = -1);
+	void mark_dirty(int joint) { dirty[joint] = 1; first_dirty = std::min(first_dirty, joint); }
+	void mark_all_dirty() { std::fill(dirty.begin(), dirty.end(), 1); first_dirty = 0; }
+
+	int size() const { return (int)world.size(); }
+
+private:
+	int first_dirty = 0;				// no joint before this one is dirty
+};
+
+#endif // LAB474_SKELETON_H_INCLUDED
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include "thread_pool.h"
+
+using namespace std;
+
+thread_pool::thread_pool(int workers)
+{
+	if (workers <= 0)
+		workers = std::max(1u, thread::hardware_concurrency());
+	for (int i = 0; i < workers; i++)
+		queues.push_back(new chunk_queue);
+	for (int i = 1; i < workers; i++)
+		threads.push_back(thread(&thread_pool::worker_loop, this, i));
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		unique_lock<mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (int i = 0; i < threads.size(); i++)
+		threads[i].join();
+	for (int i = 0; i < queues.size(); i++)
+		delete queues[i];
+}
+
+// own chunks are taken from the front, in index order; stolen ones from the back
+bool thread_pool::take(int worker, int &chunk)
+{
+	{
+		chunk_queue &own = *queues[worker];
+		unique_lock<mutex> guard(own.lock);
+		if (!own.chunks.empty())
+		{
+			chunk = own.chunks.front();
+			own.chunks.pop_front();
+			return true;
+		}
+	}
+	for (int i = 1; i < queues.size(); i++)
+	{
+		chunk_queue &victim = *queues[(worker + i) % queues.size()];
+		unique_lock<mutex> guard(victim.lock);
+		if (!victim.chunks.empty())
+		{
+			chunk = victim.chunks.back();
+			victim.chunks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+void thread_pool::run_jobs(int worker)
+{
+	// all chunks are queued before the workers wake, so empty queues mean the work is done
+	int first;
+	while (take(worker, first))
+	{
+		int last = std::min(first + job_grain, job_count);
+		for (int i = first; i < last; i++)
+			(*current)(i, worker);
+	}
+}
+
+void thread_pool::worker_loop(int worker)
+{
+	unsigned seen = 0;
+	while (true)
+	{
+		{
+			unique_lock<mutex> guard(lock);
+			while (!quit && generation == seen)
+				wake.wait(guard);
+			if (quit) return;
+			seen = generation;
+		}
+		run_jobs(worker);
+		{
+			unique_lock<mutex> guard(lock);
+			if (--busy == 0)
+				finished.notify_all();
+		}
+	}
+}
+
+void thread_pool::parallel_for(int count, const function<void(int, int)> &job, int grain)
+{
+	if (count <= 0) return;
+	grain = std::max(grain, 1);
+	int chunks = (count + grain - 1) / grain;
+	if (threads.empty() || chunks == 1)
+	{
+		for (int i = 0; i < count; i++)
+			job(i, 0);
+		return;
+	}
+
+	{
+		unique_lock<mutex> guard(lock);
+		current = &job;
+		job_count = count;
+		job_grain = grain;
+		// contiguous shares keep neighbouring indices on one worker
+		int workers = queues.size();
+		for (int w = 0; w < workers; w++)
+		{
+			unique_lock<mutex> queue_guard(queues[w]->lock);
+			for (int c = chunks * w / workers; c < chunks * (w + 1) / workers; c++)
+				queues[w]->chunks.push_back(c * grain);
+		}
+		busy = threads.size();
+		generation++;
+	}
+	wake.notify_all();
+	run_jobs(0);
+
+	unique_lock<mutex> guard(lock);
+	while (busy > 0)
+		finished.wait(guard);
+	current = NULL;
+}
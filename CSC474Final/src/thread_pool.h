@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef LAB474_THREAD_POOL_H_INCLUDED
+#define LAB474_THREAD_POOL_H_INCLUDED
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+// Fixed set of worker threads for jobs that split into independent indices.
+// The calling thread works along as worker 0, so a pool of size 1 has no threads.
+// parallel_for cuts the indices into chunks and gives every worker a contiguous share;
+// a worker that runs out steals chunks from the far end of the others' shares, so
+// uneven jobs still keep all workers busy.
+class thread_pool
+{
+public:
+	// 0 takes one worker per hardware thread
+	explicit thread_pool(int workers = 0);
+	~thread_pool();
+
+	int size() const { return (int)queues.size(); }
+
+	// runs job(index, worker) for every index in 0..count-1 and returns when all are done.
+	// worker is 0..size()-1 and is the same for all calls running on one thread.
+	// grain indices form one chunk, the unit that is handed out and stolen.
+	void parallel_for(int count, const std::function<void(int, int)> &job, int grain = 1);
+
+private:
+	thread_pool(const thread_pool &);
+	thread_pool &operator=(const thread_pool &);
+
+	struct chunk_queue
+	{
+		std::mutex lock;
+		std::deque<int> chunks;			// first index of every chunk
+	};
+
+	void worker_loop(int worker);
+	void run_jobs(int worker);
+	bool take(int worker, int &chunk);
+
+	std::vector<std::thread> threads;
+	std::vector<chunk_queue*> queues;	// one per worker
+	std::mutex lock;
+	std::condition_variable wake, finished;
+	const std::function<void(int, int)> *current = NULL;
+	int job_count = 0;
+	int job_grain = 1;
+	int busy = 0;						// workers still inside the current parallel_for
+	unsigned generation = 0;			// bumped for every parallel_for
+	bool quit = false;
+};
+
+#endif // LAB474_THREAD_POOL_H_INCLUDED
@@ -0,0 +1,21 @@
+#include "vat_texture.h"
+#include "GLSL.h"
+
+void vat_texture::upload(const anim_vat &vat)
+{
+	if (vat.frame_count() == 0) return;
+	if (!texID)
+		glGenTextures(1, &texID);
+	glBindTexture(GL_TEXTURE_2D, texID);
+	// only read with texelFetch, no filtering or mipmaps
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, vat.joints * 3, vat.frame_count(), 0, GL_RGBA, GL_FLOAT, vat.rows.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void vat_texture::bind(int unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, texID);
+}
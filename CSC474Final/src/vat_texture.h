@@ -0,0 +1,23 @@
+#pragma once
+
+#ifndef LAB474_VAT_TEXTURE_H_INCLUDED
+#define LAB474_VAT_TEXTURE_H_INCLUDED
+
+#include "anim_vat.h"
+
+// An anim_vat on the GPU as an RGBA32F 2D texture, one row per frame and 3 texels per
+// joint. The shaders fetch the two frames around the instance time with texelFetch and
+// mix them like anim_vat::sample.
+class vat_texture
+{
+public:
+	void upload(const anim_vat &vat);
+	// binds the texture to the texture unit, set the sampler uniform to the same unit
+	void bind(int unit);
+	bool is_loaded() const { return texID != 0; }
+
+private:
+	unsigned int texID = 0;
+};
+
+#endif // LAB474_VAT_TEXTURE_H_INCLUDED
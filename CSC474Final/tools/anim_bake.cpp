@@ -0,0 +1,119 @@
+// Bakes the skeleton of the first fbx file and the clips of all of them into one anim file,
+// which the game maps at startup instead of importing the fbx files.
+//   anim_bake [-sparse] [-root-motion <bone>] [-reduce <units> <degrees>] [-quantize] <out.anim> <skeleton.fbx> [more clips.fbx ...]
+// -sparse keeps the authored curves instead of sampling every bone at 24 fps,
+// -root-motion <bone> moves the horizontal translation of the bone into a root motion curve
+// and plays the clips in place (see anim_motion.h), the bone is the one that carries the travel,
+// -reduce <units> <degrees> drops keys while every joint stays within that model space error,
+// -quantize packs the sampled channels (see anim_compress.h) that are still evenly spaced.
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "bone.h"
+#include "anim_file.h"
+#include "anim_compress.h"
+#include "anim_motion.h"
+#include "anim_reduce.h"
+#include "clip_library.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+	int arg = 1;
+	bool sparse = false, quantize = false, reduce = false;
+	float pos_tolerance = 0, angle_tolerance = 0;
+	string motion_bone;
+	for (; arg < argc && argv[arg][0] == '-'; arg++)
+	{
+		if (string(argv[arg]) == "-sparse")
+			sparse = true;
+		else if (string(argv[arg]) == "-quantize")
+			quantize = true;
+		else if (string(argv[arg]) == "-root-motion" && arg + 1 < argc)
+			motion_bone = argv[++arg];
+		else if (string(argv[arg]) == "-reduce" && arg + 2 < argc)
+		{
+			reduce = true;
+			pos_tolerance = atof(argv[++arg]);
+			angle_tolerance = atof(argv[++arg]);
+		}
+		else
+			break;
+	}
+	if (argc - arg < 2)
+	{
+		cout << "usage: " << argv[0] << " [-sparse] [-root-motion <bone>] [-reduce <units> <degrees>] [-quantize] <out.anim> <skeleton.fbx> [more clips.fbx ...]" << endl;
+		return 1;
+	}
+	const char *out = argv[arg];
+
+	bone *root = NULL;
+	all_animations all_animation;
+	for (int i = arg + 1; i < argc; i++)
+		readtobone(argv[i], &all_animation, i == arg + 1 ? &root : NULL, sparse);
+	if (!root)
+	{
+		cout << "no skeleton in " << argv[arg + 1] << endl;
+		return 1;
+	}
+
+	// before the reduction, so it checks the clips as they play
+	if (!motion_bone.empty())
+	{
+		int extracted = 0;
+		for (int i = 0; i < all_animation.animations.size(); i++)
+		{
+			animation_per_bone &anim = all_animation.animations[i];
+			if (anim.bone != motion_bone || !extract_root_motion(anim))
+				continue;
+			extracted++;
+			cout << "root motion of " << anim.name << ": " << length(anim.root_motion.back().offset) << " units per loop" << endl;
+		}
+		if (extracted == 0)
+			cout << "Warning: no sampled channel of " << motion_bone << ", the clips keep their root motion" << endl;
+	}
+
+	if (reduce)
+	{
+		clip_library clips;
+		clips.build(&all_animation);
+		int animsize = 0;
+		root->set_animations(clips, animsize);
+		skeleton skel;
+		skel.build(root);
+		for (int c = 0; c < skel.clip_count; c++)
+		{
+			reduce_report report = reduce_clip(skel, c, pos_tolerance, angle_tolerance);
+			float ratio = report.keys_after > 0 ? (float)report.keys_before / report.keys_after : 0.f;
+			cout << "reduced " << clips.clip_names[c] << ": " << report.keys_before << " -> " << report.keys_after << " keys (" << ratio << ":1), worst error "
+				<< report.worst_pos << " units, " << report.worst_angle << " degrees" << endl;
+		}
+	}
+
+	if (quantize)
+	{
+		int packed = 0;
+		for (int i = 0; i < all_animation.animations.size(); i++)
+			packed += quantize_channel(all_animation.animations[i]);
+		cout << "quantized " << packed << " of " << all_animation.animations.size() << " channels" << endl;
+	}
+
+	if (!save_anim_file(out, root, all_animation))
+		return 1;
+
+	size_t keys = 0, bytes = 0;
+	for (int i = 0; i < all_animation.animations.size(); i++)
+	{
+		const animation_per_bone &anim = all_animation.animations[i];
+		keys += anim.keyframes.size() + anim.packed.keys.size();
+		bytes += anim.keyframes.size() * sizeof(keyframe) + anim.packed.keys.size() * sizeof(packed_key);
+		for (int k = 0; k < anim.curves.size(); k++)
+		{
+			keys += anim.curves[k].size();
+			bytes += anim.curves[k].size() * sizeof(curve_key);
+		}
+	}
+	cout << "baked " << all_animation.animations.size() << " channels, " << keys << " keys (" << bytes << " bytes) into " << out << endl;
+	return 0;
+}
@@ -0,0 +1,97 @@
+// Bakes every clip of an anim file into a vertex animation texture for GPU playback, then
+// reads the texture back and checks it against the skeleton evaluated on the CPU.
+//   vat_bake [-rig <file.rig>] <in.anim> <out.vat> [fps]
+// fps defaults to 60. The texture holds the joints in skeleton order, which depends on the
+// skeleton lod rules, so pass the rig description the game loads. The check reports the largest joint position error on the baked
+// frames, which only the file round trip can cause, and halfway between them, which is
+// what mixing the matrices of two frames costs.
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "anim_file.h"
+#include "anim_vat.h"
+#include "blend_tree.h"
+#include "clip_library.h"
+
+using namespace std;
+using namespace glm;
+
+int main(int argc, char **argv)
+{
+	int arg = 1;
+	const char *rig = NULL;
+	if (arg + 1 < argc && string(argv[arg]) == "-rig")
+	{
+		rig = argv[arg + 1];
+		arg += 2;
+	}
+	if (argc - arg < 2)
+	{
+		cout << "usage: " << argv[0] << " [-rig <file.rig>] <in.anim> <out.vat> [fps]" << endl;
+		return 1;
+	}
+	const char *in = argv[arg], *out = argv[arg + 1];
+	float fps = argc - arg > 2 ? atof(argv[arg + 2]) : 60.f;
+
+	anim_file file;
+	if (!file.open(in))
+		return 1;
+	bone *root = file.make_bones();
+	all_animations all_animation;
+	file.add_clips(&all_animation);
+	clip_library clips;
+	clips.build(&all_animation);
+	int animsize = 0;
+	root->set_animations(clips, animsize);
+	skeleton skel;
+	if (rig && !skel.load_rig(rig))
+		return 1;
+	skel.build(root);
+
+	anim_vat vat;
+	vat.bake(skel, fps);
+	if (!vat.save(out))
+		return 1;
+	cout << "baked " << vat.clips.size() << " clips, " << vat.frame_count() << " frames of " << vat.joints << " joints ("
+		<< vat.rows.size() * sizeof(vec4) << " bytes) into " << out << endl;
+
+	anim_vat loaded;
+	if (!loaded.load(out) || loaded.joints != skel.size() || loaded.clips.size() != skel.clip_count)
+	{
+		cout << "Error: " << out << " does not read back" << endl;
+		return 1;
+	}
+
+	skeleton_pose pose;
+	pose.bind(skel);
+	for (int c = 0; c < skel.clip_count; c++)
+	{
+		blend_tree tree;
+		tree.root = tree.add_clip(c);
+		tree.sync = false;
+		tree.bind(skel);
+
+		const vat_clip &clip = loaded.clips[c];
+		float on_frame = 0, between = 0;
+		int steps = clip.frames - 1;
+		for (int k = 0; k < steps; k++)
+			for (int half = 0; half < 2; half++)
+			{
+				tree.time_ms = (k + 0.5 * half) * clip.length_ms / steps;
+				tree.evaluate(skel, pose);
+				pose.evaluate(skel);
+				for (int j = 0; j < skel.size(); j++)
+				{
+					vec3 expected(pose.world[j][3]);
+					vec3 baked(loaded.sample(c, tree.time_ms, j)[3]);
+					float error = length(baked - expected);
+					if (half)
+						between = std::max(between, error);
+					else
+						on_frame = std::max(on_frame, error);
+				}
+			}
+		cout << clips.clip_names[c] << ": " << clip.frames << " frames, worst error " << on_frame << " units on frames, " << between << " between" << endl;
+	}
+	return 0;
+}